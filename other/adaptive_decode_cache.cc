@@ -0,0 +1,165 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/adaptive_decode_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "mpact/sim/generic/decode_cache.h"
+#include "mpact/sim/generic/instruction.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+generic::Instruction *AdaptiveDecodeCache::CountingDecoder::DecodeInstruction(
+    uint64_t address) {
+  cache_->counter_num_misses_.Increment(1);
+  uint64_t &entry = cache_->decoded_[cache_->DecodedIndex(address)];
+  if (entry == address + 1) {
+    cache_->counter_num_evictions_.Increment(1);
+    cache_->window_evictions_++;
+  }
+  entry = address + 1;
+  return cache_->decoder_->DecodeInstruction(address);
+}
+
+AdaptiveDecodeCache::AdaptiveDecodeCache(std::string name,
+                                         generic::DecoderInterface *decoder)
+    : Component(name),
+      decoder_(decoder),
+      counting_decoder_(this),
+      counter_num_lookups_("num_lookups", 0),
+      counter_num_misses_("num_misses", 0),
+      counter_num_evictions_("num_evictions", 0),
+      counter_num_resizes_("num_resizes", 0),
+      counter_num_entries_("num_entries", 0) {
+  for (auto *counter :
+       {&counter_num_lookups_, &counter_num_misses_, &counter_num_evictions_,
+        &counter_num_resizes_, &counter_num_entries_}) {
+    CHECK_OK(AddCounter(counter)) << "Failed to register counter";
+  }
+  CreateCache(options_.num_entries);
+}
+
+AdaptiveDecodeCache::~AdaptiveDecodeCache() {
+  ReleaseTable();
+  delete cache_;
+}
+
+absl::Status AdaptiveDecodeCache::Configure(const Options &options) {
+  if (options.num_entries <= 0) {
+    return absl::InvalidArgumentError("Decode cache size must be > 0");
+  }
+  if (options.minimum_pc_increment <= 0) {
+    return absl::InvalidArgumentError(
+        "Decode cache minimum pc increment must be > 0");
+  }
+  options_ = options;
+  CreateCache(options_.num_entries);
+  return absl::OkStatus();
+}
+
+void AdaptiveDecodeCache::SetPredecodedTable(
+    uint64_t base, std::vector<generic::Instruction *> table) {
+  ReleaseTable();
+  table_base_ = base;
+  table_ = std::move(table);
+}
+
+void AdaptiveDecodeCache::Invalidate(uint64_t address) {
+  uint64_t index = (address - table_base_) >> 2;
+  if ((index < table_.size()) && (table_[index] != nullptr)) {
+    table_[index]->DecRef();
+    table_[index] = nullptr;
+  }
+  uint64_t &entry = decoded_[DecodedIndex(address)];
+  if (entry == address + 1) entry = 0;
+  cache_->Invalidate(address);
+}
+
+void AdaptiveDecodeCache::InvalidateAll() {
+  ReleaseTable();
+  std::fill(decoded_.begin(), decoded_.end(), 0);
+  cache_->InvalidateAll();
+}
+
+void AdaptiveDecodeCache::PublishCounters() {
+  if (num_lookups_ == 0) return;
+  counter_num_lookups_.Increment(num_lookups_);
+  num_lookups_ = 0;
+}
+
+void AdaptiveDecodeCache::ResetCounters() {
+  num_lookups_ = 0;
+  for (auto *counter : {&counter_num_lookups_, &counter_num_misses_,
+                        &counter_num_evictions_, &counter_num_resizes_}) {
+    counter->SetValue(0);
+  }
+}
+
+void AdaptiveDecodeCache::AccumulateCounters(
+    const AdaptiveDecodeCache &other) {
+  counter_num_lookups_.Increment(other.counter_num_lookups_.GetValue());
+  counter_num_misses_.Increment(other.counter_num_misses_.GetValue());
+  counter_num_evictions_.Increment(other.counter_num_evictions_.GetValue());
+  counter_num_resizes_.Increment(other.counter_num_resizes_.GetValue());
+  counter_num_entries_.SetValue(
+      std::max(counter_num_entries_.GetValue(),
+               other.counter_num_entries_.GetValue()));
+}
+
+void AdaptiveDecodeCache::EndWindow() {
+  bool grow = (num_entries_ < options_.max_entries) &&
+              (window_evictions_ > options_.eviction_threshold * kWindowSize);
+  window_lookups_ = 0;
+  window_evictions_ = 0;
+  if (!grow) return;
+  CreateCache(std::min(num_entries_ * 2, options_.max_entries));
+  counter_num_resizes_.Increment(1);
+}
+
+void AdaptiveDecodeCache::ReleaseTable() {
+  for (auto *inst : table_) {
+    if (inst != nullptr) inst->DecRef();
+  }
+  table_.clear();
+  table_.shrink_to_fit();
+  table_base_ = 0;
+}
+
+void AdaptiveDecodeCache::CreateCache(int num_entries) {
+  // Deleting the cache releases its references to the instructions, so any
+  // that are still in use elsewhere remain valid.
+  delete cache_;
+  num_entries_ = num_entries;
+  cache_ = generic::DecodeCache::Create(
+      {num_entries_, options_.minimum_pc_increment}, &counting_decoder_);
+  // Size the table for the largest cache, so that it doesn't have to be
+  // rebuilt when the cache grows.
+  decoded_.assign(std::max(num_entries_, options_.max_entries), 0);
+  window_lookups_ = 0;
+  window_evictions_ = 0;
+  counter_num_entries_.SetValue(num_entries_);
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
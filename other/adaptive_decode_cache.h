@@ -0,0 +1,149 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_ADAPTIVE_DECODE_CACHE_H_
+#define MPACT_SIM_CODELABS_OTHER_ADAPTIVE_DECODE_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "mpact/sim/generic/component.h"
+#include "mpact/sim/generic/counters.h"
+#include "mpact/sim/generic/decode_cache.h"
+#include "mpact/sim/generic/decoder_interface.h"
+#include "mpact/sim/generic/instruction.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Wrapper around the generic decode cache that counts lookups, misses and
+// evictions, and exports them as component counters. An eviction is a miss on
+// an address that was decoded before, and not invalidated since. The cache
+// doubles in size, up to a maximum, when evictions make up more than a given
+// fraction of the lookups in a window, as that means the working set of the
+// program doesn't fit in it. Decoded addresses are remembered in a direct
+// mapped table the size of the largest cache, so only evictions that growing
+// the cache wouldn't avoid may go undetected.
+class AdaptiveDecodeCache : public generic::Component {
+ public:
+  struct Options {
+    // Cache geometry, as for generic::DecodeCache.
+    int num_entries = 16 * 1024;
+    int minimum_pc_increment = 2;
+    // Maximum number of entries the cache may grow to. The size is fixed if
+    // this isn't larger than num_entries.
+    int max_entries = 256 * 1024;
+    // Fraction of evictions in a window of lookups above which the cache
+    // grows.
+    double eviction_threshold = 0.01;
+  };
+  // Number of lookups over which the eviction rate is measured.
+  static constexpr uint64_t kWindowSize = 4096;
+
+  // The decoder is not owned by the cache.
+  AdaptiveDecodeCache(std::string name, generic::DecoderInterface *decoder);
+  ~AdaptiveDecodeCache() override;
+
+  // Changes the geometry and growth policy. All cached instructions are
+  // discarded, but not the predecoded table. Instructions that are referenced
+  // elsewhere (e.g., by basic blocks) stay valid.
+  absl::Status Configure(const Options &options);
+
+  // Installs a table of predecoded instructions, where entry i holds the
+  // instruction at base + 4 * i, or nullptr if it wasn't predecoded. The
+  // table is looked up by direct indexing before the cache. The cache takes
+  // over the references to the instructions. Any previous table is released.
+  void SetPredecodedTable(uint64_t base,
+                          std::vector<generic::Instruction *> table);
+
+  generic::Instruction *GetDecodedInstruction(uint64_t address) {
+    num_lookups_++;
+    uint64_t index = (address - table_base_) >> 2;
+    if ((index < table_.size()) && ((address & 3) == 0) &&
+        (table_[index] != nullptr)) {
+      return table_[index];
+    }
+    if (++window_lookups_ >= kWindowSize) EndWindow();
+    return cache_->GetDecodedInstruction(address);
+  }
+  void Invalidate(uint64_t address);
+  // Invalidates all cached instructions, and releases the predecoded table.
+  void InvalidateAll();
+
+  // Adds the lookups counted since the last call to the lookup counter. The
+  // counters of other caches are accumulated as of their last publication.
+  void PublishCounters();
+  // Sets the counters to zero, or adds those of another cache to them.
+  void ResetCounters();
+  void AccumulateCounters(const AdaptiveDecodeCache &other);
+
+  const Options &options() const { return options_; }
+  int num_entries() const { return num_entries_; }
+  size_t predecoded_table_size() const { return table_.size(); }
+
+ private:
+  // Forwards to the real decoder, counting the misses.
+  class CountingDecoder : public generic::DecoderInterface {
+   public:
+    explicit CountingDecoder(AdaptiveDecodeCache *cache) : cache_(cache) {}
+    generic::Instruction *DecodeInstruction(uint64_t address) override;
+
+   private:
+    AdaptiveDecodeCache *cache_;
+  };
+
+  // Called at the end of each window of lookups to apply the growth policy.
+  void EndWindow();
+  // Replaces the cache with an empty one with the given number of entries.
+  void CreateCache(int num_entries);
+  // Releases the instructions in the predecoded table, and empties it.
+  void ReleaseTable();
+  // Returns the index of the address in decoded_.
+  size_t DecodedIndex(uint64_t address) const {
+    return (address / options_.minimum_pc_increment) % decoded_.size();
+  }
+
+  generic::DecoderInterface *decoder_;
+  CountingDecoder counting_decoder_;
+  generic::DecodeCache *cache_ = nullptr;
+  Options options_;
+  int num_entries_ = 0;
+  // Predecoded instructions, indexed by (address - table_base_) >> 2.
+  uint64_t table_base_ = 0;
+  std::vector<generic::Instruction *> table_;
+  // Addresses decoded since they were last invalidated, to detect evictions.
+  // Each entry holds the address + 1, or 0 if it's empty.
+  std::vector<uint64_t> decoded_;
+  // Lookups not yet added to counter_num_lookups_.
+  uint64_t num_lookups_ = 0;
+  uint64_t window_lookups_ = 0;
+  uint64_t window_evictions_ = 0;
+  generic::SimpleCounter<uint64_t> counter_num_lookups_;
+  generic::SimpleCounter<uint64_t> counter_num_misses_;
+  generic::SimpleCounter<uint64_t> counter_num_evictions_;
+  generic::SimpleCounter<uint64_t> counter_num_resizes_;
+  generic::SimpleCounter<uint64_t> counter_num_entries_;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_ADAPTIVE_DECODE_CACHE_H_
@@ -0,0 +1,221 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/basic_block_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "riscv_isa_decoder/solution/riscv32i_enums.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Returns true if the instruction with the given opcode ends a basic block.
+static bool IsBlockTerminator(int opcode) {
+  switch (static_cast<OpcodeEnum>(opcode)) {
+    case OpcodeEnum::kBeq:
+    case OpcodeEnum::kBge:
+    case OpcodeEnum::kBgeu:
+    case OpcodeEnum::kBlt:
+    case OpcodeEnum::kBltu:
+    case OpcodeEnum::kBne:
+    case OpcodeEnum::kJal:
+    case OpcodeEnum::kJalr:
+    case OpcodeEnum::kEbreak:
+    case OpcodeEnum::kNone:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if the instruction with the given opcode may cause a halt
+// request while it executes.
+static bool MayRequestHalt(int opcode) {
+  switch (static_cast<OpcodeEnum>(opcode)) {
+    case OpcodeEnum::kAdd:
+    case OpcodeEnum::kAddi:
+    case OpcodeEnum::kAnd:
+    case OpcodeEnum::kAndi:
+    case OpcodeEnum::kAuipc:
+    case OpcodeEnum::kLui:
+    case OpcodeEnum::kOr:
+    case OpcodeEnum::kOri:
+    case OpcodeEnum::kSll:
+    case OpcodeEnum::kSlli:
+    case OpcodeEnum::kSltu:
+    case OpcodeEnum::kSrai:
+    case OpcodeEnum::kSrli:
+    case OpcodeEnum::kSub:
+    case OpcodeEnum::kXor:
+    case OpcodeEnum::kXori:
+    case OpcodeEnum::kBeq:
+    case OpcodeEnum::kBge:
+    case OpcodeEnum::kBgeu:
+    case OpcodeEnum::kBlt:
+    case OpcodeEnum::kBltu:
+    case OpcodeEnum::kBne:
+    case OpcodeEnum::kJal:
+    case OpcodeEnum::kJalr:
+    case OpcodeEnum::kLb:
+    case OpcodeEnum::kLbu:
+    case OpcodeEnum::kLh:
+    case OpcodeEnum::kLhu:
+    case OpcodeEnum::kLw:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// Returns true if the instruction with the given opcode is a load.
+static bool IsLoad(int opcode) {
+  switch (static_cast<OpcodeEnum>(opcode)) {
+    case OpcodeEnum::kLb:
+    case OpcodeEnum::kLbu:
+    case OpcodeEnum::kLh:
+    case OpcodeEnum::kLhu:
+    case OpcodeEnum::kLw:
+      return true;
+    default:
+      return false;
+  }
+}
+
+BasicBlockCache::BasicBlockCache(AdaptiveDecodeCache *decode_cache)
+    : decode_cache_(decode_cache) {}
+
+BasicBlockCache::~BasicBlockCache() { InvalidateAll(); }
+
+BasicBlock *BasicBlockCache::GetBlock(uint32_t address) {
+  auto iter = block_map_.find(address);
+  if (iter != block_map_.end()) return iter->second;
+  auto *block = BuildBlock(address);
+  block_map_.emplace(address, block);
+  uint32_t last_page = (block->end_address - 1) >> kPageShift;
+  for (uint32_t page = address >> kPageShift; page <= last_page; page++) {
+    page_blocks_[page].push_back(block);
+  }
+  return block;
+}
+
+BasicBlock *BasicBlockCache::GetSuccessor(BasicBlock *block,
+                                          uint32_t address) {
+  for (auto &link : block->successors) {
+    if ((link.generation == generation_) && (link.address == address)) {
+      return link.block;
+    }
+  }
+  auto *successor = GetBlock(address);
+  auto &link = block->successors[address == block->end_address ? 0 : 1];
+  link.address = address;
+  link.block = successor;
+  link.generation = generation_;
+  return successor;
+}
+
+void BasicBlockCache::Invalidate(uint64_t address) {
+  auto page_iter = page_blocks_.find(address >> kPageShift);
+  if (page_iter == page_blocks_.end()) return;
+  std::vector<BasicBlock *> stale;
+  for (auto *block : page_iter->second) {
+    if ((address >= block->start_address) && (address < block->end_address)) {
+      stale.push_back(block);
+    }
+  }
+  if (stale.empty()) return;
+  for (auto *block : stale) {
+    // Remove the block from the index of each page it overlaps.
+    uint32_t last_page = (block->end_address - 1) >> kPageShift;
+    for (uint32_t page = block->start_address >> kPageShift; page <= last_page;
+         page++) {
+      auto iter = page_blocks_.find(page);
+      auto &blocks = iter->second;
+      blocks.erase(std::find(blocks.begin(), blocks.end(), block));
+      if (blocks.empty()) page_blocks_.erase(iter);
+    }
+    block_map_.erase(block->start_address);
+    DeleteBlock(block);
+  }
+  generation_++;
+}
+
+void BasicBlockCache::InvalidateAll() {
+  for (auto &[unused, block] : block_map_) DeleteBlock(block);
+  block_map_.clear();
+  page_blocks_.clear();
+  generation_++;
+}
+
+void BasicBlockCache::set_loads_may_halt(bool value) {
+  if (loads_may_halt_ == value) return;
+  loads_may_halt_ = value;
+  // The halt check masks of all blocks have to be recomputed.
+  InvalidateAll();
+}
+
+void BasicBlockCache::SetBreakpoint(uint32_t address) {
+  if (!breakpoints_.insert(address).second) return;
+  // The block that contains the address has to be split.
+  Invalidate(address);
+}
+
+void BasicBlockCache::ClearBreakpoint(uint32_t address) {
+  if (breakpoints_.erase(address) == 0) return;
+  // The block that starts at the address is marked as a breakpoint. The block
+  // before it stays split, which is harmless.
+  Invalidate(address);
+}
+
+void BasicBlockCache::ClearAllBreakpoints() {
+  if (breakpoints_.empty()) return;
+  breakpoints_.clear();
+  InvalidateAll();
+}
+
+BasicBlock *BasicBlockCache::BuildBlock(uint32_t address) {
+  auto *block = new BasicBlock;
+  block->start_address = address;
+  block->is_breakpoint = breakpoints_.contains(address);
+  uint32_t pc = address;
+  for (int i = 0; i < kMaxBlockLength; i++) {
+    // End the block before the next breakpoint.
+    if ((i > 0) && !breakpoints_.empty() && breakpoints_.contains(pc)) break;
+    auto *inst = decode_cache_->GetDecodedInstruction(pc);
+    // The decode cache may evict the instruction, so hold a reference to it
+    // for as long as the block exists.
+    inst->IncRef();
+    if (MayRequestHalt(inst->opcode()) ||
+        (loads_may_halt_ && IsLoad(inst->opcode()))) {
+      block->halt_check_mask |= uint64_t{1} << i;
+    }
+    block->instructions.push_back(inst);
+    pc += inst->size();
+    if (IsBlockTerminator(inst->opcode())) break;
+  }
+  block->end_address = pc;
+  return block;
+}
+
+void BasicBlockCache::DeleteBlock(BasicBlock *block) {
+  for (auto *inst : block->instructions) inst->DecRef();
+  delete block;
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_BASIC_BLOCK_CACHE_H_
+#define MPACT_SIM_CODELABS_OTHER_BASIC_BLOCK_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "mpact/sim/generic/instruction.h"
+#include "other/adaptive_decode_cache.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::Instruction;
+
+// A single operation in the threaded code of a basic block. The handler is the
+// address of the code that implements the operation in the threaded
+// interpreter. Register indices and immediate values are extracted from the
+// instruction word when the block is lowered, so that the handler doesn't have
+// to go through the operand interfaces.
+struct ThreadedOp {
+  const void *handler = nullptr;
+  // The instruction the operation was lowered from. Used for instructions that
+  // aren't handled directly, and to compute addresses.
+  Instruction *inst = nullptr;
+  uint8_t rd = 0;
+  uint8_t rs1 = 0;
+  uint8_t rs2 = 0;
+  // Immediate value, or for branches and jal, the target address.
+  uint32_t imm = 0;
+};
+
+// Information used to trace an instruction, extracted from the instruction
+// word when the block is first traced.
+struct TraceInfo {
+  uint32_t word = 0;
+  // Destination register, or 0 if the instruction doesn't write a register.
+  uint8_t rd = 0;
+  // For loads and stores, the memory address is rs1 + offset.
+  bool is_memory_access = false;
+  uint8_t rs1 = 0;
+  uint32_t offset = 0;
+  // Tracing epoch in which the instruction word was last recorded.
+  uint64_t word_epoch = 0;
+};
+
+// A basic block is a straight-line sequence of decoded instructions. It ends
+// with the first control transfer instruction (branch, jal, jalr, ebreak, or
+// an illegal instruction), before a software breakpoint, or when the maximum
+// block length is reached. Only the last instruction in a block may change the
+// pc.
+struct BasicBlock {
+  // Link to a successor block. A link is only valid if its generation matches
+  // that of the block cache, so that links to invalidated blocks are ignored.
+  struct Link {
+    uint32_t address = 0;
+    BasicBlock *block = nullptr;
+    uint64_t generation = 0;
+  };
+
+  // Address of the first instruction in the block.
+  uint32_t start_address = 0;
+  // Address following the last instruction in the block.
+  uint32_t end_address = 0;
+  // True if there is a software breakpoint at the start address.
+  bool is_breakpoint = false;
+  // The instructions in the block. The block holds a reference to each one.
+  std::vector<Instruction *> instructions;
+  // Bit i is set if instruction i may itself request the core to halt (e.g.,
+  // a store to a semihosting address), and so must be followed by a check of
+  // the halt flag.
+  uint64_t halt_check_mask = 0;
+  // Threaded code for the block. Empty until the block is first executed by
+  // the threaded interpreter.
+  std::vector<ThreadedOp> threaded_code;
+  // Trace information for each instruction. Empty until the block is first
+  // executed with tracing enabled.
+  std::vector<TraceInfo> trace_info;
+  // Successor links. Entry 0 is the fall through successor, and entry 1 is the
+  // most recently taken (non fall through) successor.
+  Link successors[2];
+};
+
+// The basic block cache builds basic blocks from instructions obtained from
+// the decode cache, and caches them by their start address. Successor blocks
+// are chained directly, so that in the common case of a loop, no lookup is
+// needed to find the next block to execute.
+class BasicBlockCache {
+ public:
+  // Maximum number of instructions in a basic block.
+  static constexpr int kMaxBlockLength = 64;
+  static_assert(kMaxBlockLength <= 64, "Block length exceeds halt check mask");
+
+  explicit BasicBlockCache(AdaptiveDecodeCache *decode_cache);
+  ~BasicBlockCache();
+
+  // Returns the basic block starting at address, building it if needed.
+  BasicBlock *GetBlock(uint32_t address);
+  // Returns the block starting at address that executes after block. Follows
+  // the successor links of block if possible, and updates them otherwise.
+  BasicBlock *GetSuccessor(BasicBlock *block, uint32_t address);
+  // Invalidate any block that contains the given address. Only the blocks
+  // that overlap the page of the address are examined.
+  void Invalidate(uint64_t address);
+  // Invalidate all blocks.
+  void InvalidateAll();
+
+  // Software breakpoints are kept in a table instead of being patched into
+  // memory. Blocks are split so that each breakpoint is at the start of a
+  // block, where it can be checked before the block executes. Setting or
+  // clearing a breakpoint only invalidates the block that contains it, and
+  // leaves the decode cache alone.
+  void SetBreakpoint(uint32_t address);
+  void ClearBreakpoint(uint32_t address);
+  void ClearAllBreakpoints();
+  bool HasBreakpoint(uint32_t address) const {
+    return breakpoints_.contains(address);
+  }
+  const absl::flat_hash_set<uint32_t> &breakpoints() const {
+    return breakpoints_;
+  }
+
+  // When set, loads are treated as instructions that may request a halt, e.g.,
+  // because they may hit a data watchpoint. Changing it invalidates all blocks.
+  void set_loads_may_halt(bool value);
+  bool loads_may_halt() const { return loads_may_halt_; }
+
+ private:
+  // Size of the pages by which the blocks are indexed. A block spans at most
+  // two pages.
+  static constexpr int kPageShift = 12;
+
+  BasicBlock *BuildBlock(uint32_t address);
+  void DeleteBlock(BasicBlock *block);
+
+  AdaptiveDecodeCache *decode_cache_;
+  absl::flat_hash_map<uint32_t, BasicBlock *> block_map_;
+  // The blocks that overlap each page, indexed by page number.
+  absl::flat_hash_map<uint32_t, std::vector<BasicBlock *>> page_blocks_;
+  absl::flat_hash_set<uint32_t> breakpoints_;
+  bool loads_may_halt_ = false;
+  // Incremented on each invalidation, so that stale successor links aren't
+  // followed.
+  uint64_t generation_ = 1;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_BASIC_BLOCK_CACHE_H_
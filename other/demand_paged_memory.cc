@@ -0,0 +1,122 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/demand_paged_memory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "other/memory_load.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+DemandPagedMemory::DemandPagedMemory() = default;
+
+DemandPagedMemory::~DemandPagedMemory() {
+  for (auto *table : directory_) {
+    if (table == nullptr) continue;
+    for (uint64_t i = 0; i < kTableSize; i++) delete[] table[i];
+    delete[] table;
+  }
+}
+
+uint8_t *DemandPagedMemory::GetOrAllocatePage(uint64_t address) {
+  uint64_t page = (address >> kPageShift) & (kNumPages - 1);
+  uint8_t **&table = directory_[page >> kTableShift];
+  if (table == nullptr) table = new uint8_t *[kTableSize]();
+  uint8_t *&host = table[page & (kTableSize - 1)];
+  if (host == nullptr) host = new uint8_t[kPageSize]();
+  return host;
+}
+
+void DemandPagedMemory::Read(uint64_t address, uint8_t *buffer,
+                             uint64_t size) const {
+  while (size > 0) {
+    uint64_t offset = address & (kPageSize - 1);
+    uint64_t count = std::min(size, kPageSize - offset);
+    const uint8_t *host = GetPage(address);
+    if (host == nullptr) {
+      std::memset(buffer, 0, count);
+    } else {
+      std::memcpy(buffer, host + offset, count);
+    }
+    address += count;
+    buffer += count;
+    size -= count;
+  }
+}
+
+void DemandPagedMemory::Write(uint64_t address, const uint8_t *buffer,
+                              uint64_t size) {
+  while (size > 0) {
+    uint64_t offset = address & (kPageSize - 1);
+    uint64_t count = std::min(size, kPageSize - offset);
+    std::memcpy(GetOrAllocatePage(address) + offset, buffer, count);
+    address += count;
+    buffer += count;
+    size -= count;
+  }
+}
+
+void DemandPagedMemory::Load(uint64_t address, DataBuffer *db,
+                             Instruction *inst, ReferenceCount *context) {
+  Read(address, static_cast<uint8_t *>(db->raw_ptr()), db->size<uint8_t>());
+  FinishLoad(db, inst, context);
+}
+
+void DemandPagedMemory::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                             int el_size, DataBuffer *db, Instruction *inst,
+                             ReferenceCount *context) {
+  int num_addresses = address_db->size<uint64_t>();
+  int num_elements = mask_db->size<bool>();
+  auto *data = static_cast<uint8_t *>(db->raw_ptr());
+  for (int i = 0; i < num_elements; i++) {
+    if (!mask_db->Get<bool>(i)) continue;
+    // A single address is the base of consecutive elements.
+    uint64_t address = num_addresses == 1
+                           ? address_db->Get<uint64_t>(0) + i * el_size
+                           : address_db->Get<uint64_t>(i);
+    Read(address, data + i * el_size, el_size);
+  }
+  FinishLoad(db, inst, context);
+}
+
+void DemandPagedMemory::Store(uint64_t address, DataBuffer *db) {
+  Write(address, static_cast<const uint8_t *>(db->raw_ptr()),
+        db->size<uint8_t>());
+}
+
+void DemandPagedMemory::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                              int el_size, DataBuffer *db) {
+  int num_addresses = address_db->size<uint64_t>();
+  int num_elements = mask_db->size<bool>();
+  auto *data = static_cast<const uint8_t *>(db->raw_ptr());
+  for (int i = 0; i < num_elements; i++) {
+    if (!mask_db->Get<bool>(i)) continue;
+    uint64_t address = num_addresses == 1
+                           ? address_db->Get<uint64_t>(0) + i * el_size
+                           : address_db->Get<uint64_t>(i);
+    Write(address, data + i * el_size, el_size);
+  }
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_DEMAND_PAGED_MEMORY_H_
+#define MPACT_SIM_CODELABS_OTHER_DEMAND_PAGED_MEMORY_H_
+
+#include <cstdint>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::Instruction;
+using ::mpact::sim::generic::ReferenceCount;
+
+// Memory for the 32 bit address space that allocates host pages as they are
+// first stored to. Pages that haven't been allocated read as zero. Unlike
+// util::FlatDemandMemory, it exposes the host address of its pages, so that
+// the instructions can access them directly (see RiscVState::HostPointer).
+// Pages are never released while the memory exists, so the host addresses
+// stay valid.
+class DemandPagedMemory : public util::MemoryInterface {
+ public:
+  static constexpr int kPageShift = 12;
+  static constexpr uint64_t kPageSize = uint64_t{1} << kPageShift;
+
+  DemandPagedMemory();
+  ~DemandPagedMemory() override;
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+  // Returns the host address of the page that holds the address, or nullptr
+  // if the page hasn't been allocated.
+  uint8_t *GetPage(uint64_t address) const {
+    uint64_t page = (address >> kPageShift) & (kNumPages - 1);
+    uint8_t **table = directory_[page >> kTableShift];
+    return table == nullptr ? nullptr : table[page & (kTableSize - 1)];
+  }
+
+ private:
+  // Two level page table: the directory points to tables of page pointers.
+  static constexpr uint64_t kNumPages = (uint64_t{1} << 32) >> kPageShift;
+  static constexpr int kTableShift = 10;
+  static constexpr uint64_t kTableSize = uint64_t{1} << kTableShift;
+  static constexpr uint64_t kDirectorySize = kNumPages >> kTableShift;
+
+  uint8_t *GetOrAllocatePage(uint64_t address);
+  // Copy between the address space and a host buffer.
+  void Read(uint64_t address, uint8_t *buffer, uint64_t size) const;
+  void Write(uint64_t address, const uint8_t *buffer, uint64_t size);
+
+  uint8_t **directory_[kDirectorySize] = {};
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_DEMAND_PAGED_MEMORY_H_
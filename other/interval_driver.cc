@@ -0,0 +1,194 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/interval_driver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>  // NOLINT: third_party code.
+#include <fstream>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <thread>  // NOLINT: third_party code.
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "mpact/sim/proto/component_data.pb.h"
+#include "other/rv32i_top.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+IntervalDriver::IntervalDriver(uint64_t interval_length, int num_threads,
+                               ConfigureFunction configure)
+    : interval_length_(interval_length),
+      num_threads_(num_threads),
+      configure_(std::move(configure)) {
+  if (num_threads_ <= 0) {
+    num_threads_ = std::max(1u, std::thread::hardware_concurrency());
+  }
+  merged_ = new RV32ITop("RV32I");
+}
+
+IntervalDriver::~IntervalDriver() {
+  delete merged_;
+  if (!checkpoint_directory_.empty()) {
+    std::error_code error;
+    std::filesystem::remove_all(checkpoint_directory_, error);
+  }
+}
+
+std::string IntervalDriver::CheckpointFileName(int index) const {
+  return absl::StrCat(checkpoint_directory_, "/interval", index, ".ckpt");
+}
+
+absl::Status IntervalDriver::Run(RV32ITop *top) {
+  if (interval_length_ == 0) {
+    return absl::InvalidArgumentError(
+        "IntervalDriver: Interval length must be > 0");
+  }
+  if (checkpoint_directory_.empty()) {
+    std::string name_template =
+        (std::filesystem::temp_directory_path() / "rv32i_intervals_XXXXXX")
+            .string();
+    if (mkdtemp(name_template.data()) == nullptr) {
+      return absl::InternalError(
+          "IntervalDriver: Failed to create checkpoint directory");
+    }
+    checkpoint_directory_ = name_template;
+  }
+  auto status = RecordCheckpoints(top);
+  if (!status.ok()) return status;
+
+  // Hand out the intervals from a shared index, so that the load is balanced
+  // across the threads.
+  size_t num_intervals = interval_instructions_.size();
+  std::atomic<size_t> next_interval = 0;
+  std::vector<absl::Status> statuses(num_intervals);
+  std::vector<std::thread> workers;
+  int num_workers = std::min<int>(num_threads_, num_intervals);
+  for (int w = 0; w < num_workers; w++) {
+    workers.emplace_back([this, num_intervals, &next_interval, &statuses]() {
+      for (size_t i = next_interval.fetch_add(1); i < num_intervals;
+           i = next_interval.fetch_add(1)) {
+        statuses[i] = SimulateInterval(i);
+      }
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  for (auto &interval_status : statuses) {
+    if (!interval_status.ok()) return interval_status;
+  }
+  // The re-simulated intervals must add up to the first pass.
+  if (merged_->num_instructions() != top->num_instructions()) {
+    return absl::InternalError(absl::StrCat(
+        "IntervalDriver: Intervals executed ", merged_->num_instructions(),
+        " instructions, expected ", top->num_instructions()));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IntervalDriver::Export(proto::ComponentData *component_data) {
+  return merged_->Export(component_data);
+}
+
+absl::Status IntervalDriver::RecordCheckpoints(RV32ITop *top) {
+  interval_instructions_.clear();
+  interval_first_requests_.clear();
+  semihost_log_.stores.clear();
+  has_semihosting_ = top->has_semihosting();
+  if (has_semihosting_) {
+    semihost_magic_ = top->semihost_magic();
+    auto status = top->set_semihost_log(&semihost_log_);
+    if (!status.ok()) return status;
+  }
+  top->ResetCounters();
+  // The first pass only needs to count instructions.
+  bool saved_collect_statistics = top->collect_statistics();
+  top->set_collect_statistics(false);
+  // The instruction limit of the core, if any, applies to the whole run.
+  uint64_t saved_limit = top->instruction_limit();
+  uint64_t remaining = saved_limit == 0 ? std::numeric_limits<uint64_t>::max()
+                                        : saved_limit;
+  absl::Status status;
+  while (remaining > 0) {
+    int index = interval_instructions_.size();
+    std::ofstream checkpoint(CheckpointFileName(index), std::ios::binary);
+    status = top->SaveCheckpoint(checkpoint);
+    checkpoint.close();
+    if (!status.ok()) break;
+    uint64_t first_request = top->num_semihost_requests();
+    uint64_t start = top->num_instructions();
+    top->set_instruction_limit(std::min(interval_length_, remaining));
+    status = top->RunToHalt();
+    if (!status.ok()) break;
+    uint64_t count = top->num_instructions() - start;
+    // An empty interval means the program halted right at the boundary.
+    if (count == 0) break;
+    interval_instructions_.push_back(count);
+    interval_first_requests_.push_back(first_request);
+    remaining -= count;
+    // Continue as long as the program only stopped due to the interval limit.
+    auto halt_reason = top->GetLastHaltReason();
+    if (!halt_reason.ok()) {
+      status = halt_reason.status();
+      break;
+    }
+    if (halt_reason.value() != *RV32ITop::kInstructionLimitHaltReason) break;
+  }
+  top->set_instruction_limit(saved_limit);
+  top->set_collect_statistics(saved_collect_statistics);
+  if (has_semihosting_) (void)top->set_semihost_log(nullptr);
+  return status;
+}
+
+absl::Status IntervalDriver::SimulateInterval(int index) {
+  RV32ITop top(absl::StrCat("interval", index));
+  if (configure_) configure_(&top);
+  std::ifstream checkpoint(CheckpointFileName(index), std::ios::binary);
+  if (!checkpoint.good()) {
+    return absl::NotFoundError(
+        absl::StrCat("IntervalDriver: Failed to open ",
+                     CheckpointFileName(index)));
+  }
+  auto status =
+      top.RestoreCheckpoint(checkpoint, /*set_up_semihosting=*/false);
+  if (!status.ok()) return status;
+  // The semihosting requests get the replies recorded in the first pass.
+  if (has_semihosting_) {
+    status = top.ReplaySemiHosting(semihost_magic_, &semihost_log_,
+                                   interval_first_requests_[index]);
+    if (!status.ok()) return status;
+  }
+  // Only count what is executed in this interval.
+  top.ResetCounters();
+  top.set_instruction_limit(interval_instructions_[index]);
+  status = top.RunToHalt();
+  if (!status.ok()) return status;
+  absl::MutexLock lock(&merged_mutex_);
+  merged_->AccumulateCounters(top);
+  return absl::OkStatus();
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_INTERVAL_DRIVER_H_
+#define MPACT_SIM_CODELABS_OTHER_INTERVAL_DRIVER_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "mpact/sim/proto/component_data.pb.h"
+#include "other/rv32i_top.h"
+#include "other/semihost_replay.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// The interval driver simulates a program in two passes. The first pass runs
+// the program from start to finish without collecting statistics, saving a
+// checkpoint every interval_length instructions. The second pass re-simulates
+// each interval, starting from its checkpoint and executing exactly as many
+// instructions as the first pass did, with the intervals distributed over a
+// number of host threads. The counters of all the intervals are then merged,
+// so that the result is the same as that of a single run, but the wall clock
+// time of the second pass scales with the number of threads.
+//
+// Semihosting is only active during the first pass, so that side effects such
+// as program output aren't repeated by the second pass. The replies of the
+// semihost are recorded in the first pass, and are replayed to the intervals
+// in the second pass, so that they follow the same path. The checkpoints are
+// kept in files in a temporary directory, which is removed with the driver.
+class IntervalDriver {
+ public:
+  // Function called to configure each core the driver creates, e.g., to
+  // select the threaded interpreter.
+  using ConfigureFunction = std::function<void(RV32ITop *)>;
+
+  // If num_threads is 0, one thread per host cpu is used.
+  IntervalDriver(uint64_t interval_length, int num_threads,
+                 ConfigureFunction configure);
+  ~IntervalDriver();
+
+  // Simulates the program that has been loaded into the given core, which is
+  // used for the first pass. The core must be halted and own its memory.
+  absl::Status Run(RV32ITop *top);
+
+  // Exports the merged counters.
+  absl::Status Export(proto::ComponentData *component_data);
+
+  // Accessors.
+  int num_intervals() const { return interval_instructions_.size(); }
+  // Top instance that holds the merged counters.
+  RV32ITop *merged() const { return merged_; }
+
+ private:
+  // Runs the first pass, collecting the checkpoints.
+  absl::Status RecordCheckpoints(RV32ITop *top);
+  // Re-simulates the given interval, and adds its counters to merged_.
+  absl::Status SimulateInterval(int index);
+
+  uint64_t interval_length_;
+  int num_threads_;
+  ConfigureFunction configure_;
+  // Returns the name of the checkpoint file of the given interval.
+  std::string CheckpointFileName(int index) const;
+
+  // Directory that holds the checkpoint at the start of each interval.
+  std::string checkpoint_directory_;
+  // The number of instructions in each interval, and the number of semihosting
+  // requests made before it.
+  std::vector<uint64_t> interval_instructions_;
+  std::vector<uint64_t> interval_first_requests_;
+  // Semihosting set up of the first pass, and the replies it recorded.
+  bool has_semihosting_ = false;
+  RV32ITop::SemiHostAddresses semihost_magic_ = {};
+  SemiHostLog semihost_log_;
+  absl::Mutex merged_mutex_;
+  RV32ITop *merged_ = nullptr;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_INTERVAL_DRIVER_H_
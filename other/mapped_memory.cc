@@ -0,0 +1,190 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/mapped_memory.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "other/memory_load.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+absl::StatusOr<MappedMemory *> MappedMemory::Create() {
+  // The reservation doesn't count against the commit limit, and reads as
+  // zero until written.
+  void *base = mmap(nullptr, kSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    return absl::ResourceExhaustedError(
+        "Unable to reserve host memory for the address space");
+  }
+  return new MappedMemory(static_cast<uint8_t *>(base));
+}
+
+MappedMemory::~MappedMemory() { munmap(base_, kSize); }
+
+void MappedMemory::Read(uint64_t address, void *buffer, uint64_t size) const {
+  address &= kSize - 1;
+  uint64_t first = std::min(size, kSize - address);
+  std::memcpy(buffer, base_ + address, first);
+  if (first < size) {
+    std::memcpy(static_cast<uint8_t *>(buffer) + first, base_, size - first);
+  }
+}
+
+void MappedMemory::Write(uint64_t address, const void *buffer,
+                         uint64_t size) {
+  address &= kSize - 1;
+  uint64_t first = std::min(size, kSize - address);
+  std::memcpy(base_ + address, buffer, first);
+  if (first < size) {
+    std::memcpy(base_, static_cast<const uint8_t *>(buffer) + first,
+                size - first);
+  }
+}
+
+void MappedMemory::Load(uint64_t address, DataBuffer *db, Instruction *inst,
+                        ReferenceCount *context) {
+  Read(address, db->raw_ptr(), db->size<uint8_t>());
+  FinishLoad(db, inst, context);
+}
+
+void MappedMemory::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                        int el_size, DataBuffer *db, Instruction *inst,
+                        ReferenceCount *context) {
+  int num_addresses = address_db->size<uint64_t>();
+  int num_elements = mask_db->size<bool>();
+  auto *data = static_cast<uint8_t *>(db->raw_ptr());
+  for (int i = 0; i < num_elements; i++) {
+    if (!mask_db->Get<bool>(i)) continue;
+    // A single address is the base of consecutive elements.
+    uint64_t address = num_addresses == 1
+                           ? address_db->Get<uint64_t>(0) + i * el_size
+                           : address_db->Get<uint64_t>(i);
+    Read(address, data + i * el_size, el_size);
+  }
+  FinishLoad(db, inst, context);
+}
+
+void MappedMemory::Store(uint64_t address, DataBuffer *db) {
+  Write(address, db->raw_ptr(), db->size<uint8_t>());
+}
+
+void MappedMemory::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                         int el_size, DataBuffer *db) {
+  int num_addresses = address_db->size<uint64_t>();
+  int num_elements = mask_db->size<bool>();
+  auto *data = static_cast<const uint8_t *>(db->raw_ptr());
+  for (int i = 0; i < num_elements; i++) {
+    if (!mask_db->Get<bool>(i)) continue;
+    uint64_t address = num_addresses == 1
+                           ? address_db->Get<uint64_t>(0) + i * el_size
+                           : address_db->Get<uint64_t>(i);
+    Write(address, data + i * el_size, el_size);
+  }
+}
+
+absl::Status MappedMemory::MapFile(uint64_t address,
+                                   const std::string &file_name,
+                                   uint64_t offset, uint64_t file_size,
+                                   uint64_t memory_size) {
+  file_size = std::min(file_size, memory_size);
+  if ((address >= kSize) || (memory_size > kSize - address)) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Segment at 0x", absl::Hex(address), " of size ",
+                     memory_size, " exceeds the address space"));
+  }
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("Unable to open '", file_name, "'"));
+  }
+  const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  const uint64_t page_mask = page_size - 1;
+  uint64_t file_end = address + file_size;
+  // Only whole host pages can be mapped, and the file offset must have the
+  // same alignment as the address. Partial pages at either end are shared with
+  // whatever else is in memory there, so they are copied.
+  uint64_t map_start = address;
+  uint64_t map_end = address;
+  if (((address - offset) & page_mask) == 0) {
+    map_start = std::min(file_end, (address + page_mask) & ~page_mask);
+    map_end = std::max(map_start, file_end & ~page_mask);
+  }
+  if (map_end > map_start) {
+    void *mapping =
+        mmap(base_ + map_start, map_end - map_start, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, offset + (map_start - address));
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      return absl::InternalError(
+          absl::StrCat("Unable to map '", file_name, "'"));
+    }
+    mapped_bytes_ += map_end - map_start;
+  }
+  // Copy the remaining file data directly into the address space.
+  auto copy = [&](uint64_t start, uint64_t end) {
+    while (start < end) {
+      ssize_t count = pread(fd, base_ + start, end - start,
+                            offset + (start - address));
+      if (count <= 0) return false;
+      start += count;
+    }
+    return true;
+  };
+  bool ok = copy(address, map_start) && copy(map_end, file_end);
+  close(fd);
+  if (!ok) {
+    return absl::InternalError(
+        absl::StrCat("Unable to read '", file_name, "'"));
+  }
+  // Zero fill the rest of the segment. Whole pages are replaced by fresh
+  // anonymous pages rather than cleared, so that they aren't allocated until
+  // written.
+  uint64_t memory_end = address + memory_size;
+  uint64_t zero_start =
+      std::min(memory_end, (file_end + page_mask) & ~page_mask);
+  uint64_t zero_end = std::max(zero_start, memory_end & ~page_mask);
+  std::memset(base_ + file_end, 0, zero_start - file_end);
+  if (zero_end > zero_start) {
+    void *zeros = mmap(base_ + zero_start, zero_end - zero_start,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                       -1, 0);
+    if (zeros == MAP_FAILED) {
+      std::memset(base_ + zero_start, 0, zero_end - zero_start);
+    }
+  }
+  std::memset(base_ + zero_end, 0, memory_end - zero_end);
+  return absl::OkStatus();
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_MAPPED_MEMORY_H_
+#define MPACT_SIM_CODELABS_OTHER_MAPPED_MEMORY_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::Instruction;
+using ::mpact::sim::generic::ReferenceCount;
+
+// Memory that backs the whole 32 bit address space with a single reservation
+// of host virtual memory. Host pages are only allocated when they are first
+// written, so unused parts of the address space cost nothing. Ranges of a file
+// can be mapped copy-on-write into the address space, e.g., the segments of an
+// elf file, so that loading a program doesn't copy its contents. A file backed
+// page is read from the page cache, and only gets a private copy when it is
+// written.
+class MappedMemory : public util::MemoryInterface {
+ public:
+  static constexpr uint64_t kSize = uint64_t{1} << 32;
+
+  static absl::StatusOr<MappedMemory *> Create();
+  ~MappedMemory() override;
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+  // Sets [address, address + memory_size) to the file_size bytes at offset in
+  // the file, followed by zeros. The host pages that lie entirely within the
+  // file data are mapped from the file if the address and offset are equally
+  // aligned, and the remaining bytes are copied.
+  absl::Status MapFile(uint64_t address, const std::string &file_name,
+                       uint64_t offset, uint64_t file_size,
+                       uint64_t memory_size);
+
+  // Guest address a is at host_base() + a.
+  uint8_t *host_base() const { return base_; }
+  // Number of bytes mapped from files.
+  uint64_t mapped_bytes() const { return mapped_bytes_; }
+
+ private:
+  explicit MappedMemory(uint8_t *base) : base_(base) {}
+
+  // Copy between the address space and a host buffer, wrapping around at the
+  // end of the address space.
+  void Read(uint64_t address, void *buffer, uint64_t size) const;
+  void Write(uint64_t address, const void *buffer, uint64_t size);
+
+  uint8_t *base_;
+  uint64_t mapped_bytes_ = 0;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_MAPPED_MEMORY_H_
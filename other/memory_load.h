@@ -0,0 +1,53 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_MEMORY_LOAD_H_
+#define MPACT_SIM_CODELABS_OTHER_MEMORY_LOAD_H_
+
+#include "mpact/sim/generic/arch_state.h"
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/function_delay_line.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Completes a load by executing the instruction that writes back the data,
+// after the latency of the data buffer. Used by the memories that implement
+// util::MemoryInterface directly.
+inline void FinishLoad(generic::DataBuffer *db, generic::Instruction *inst,
+                       generic::ReferenceCount *context) {
+  if (inst == nullptr) return;
+  if (db->latency() == 0) {
+    inst->Execute(context);
+    return;
+  }
+  inst->IncRef();
+  if (context != nullptr) context->IncRef();
+  inst->state()->function_delay_line()->Add(db->latency(), [inst, context]() {
+    inst->Execute(context);
+    if (context != nullptr) context->DecRef();
+    inst->DecRef();
+  });
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_MEMORY_LOAD_H_
@@ -0,0 +1,77 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/page_tracking_memory.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+PageTrackingMemory::PageTrackingMemory(util::MemoryInterface *memory)
+    : memory_(memory), touched_(kNumPages / 64, 0) {}
+
+void PageTrackingMemory::Load(uint64_t address, DataBuffer *db,
+                              Instruction *inst, ReferenceCount *context) {
+  memory_->Load(address, db, inst, context);
+}
+
+void PageTrackingMemory::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                              int el_size, DataBuffer *db, Instruction *inst,
+                              ReferenceCount *context) {
+  memory_->Load(address_db, mask_db, el_size, db, inst, context);
+}
+
+void PageTrackingMemory::Store(uint64_t address, DataBuffer *db) {
+  MarkTouched(address, db->size<uint8_t>());
+  memory_->Store(address, db);
+}
+
+void PageTrackingMemory::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                               int el_size, DataBuffer *db) {
+  // Masked off elements are marked as well, which is harmless.
+  for (unsigned i = 0; i < address_db->size<uint64_t>(); i++) {
+    MarkTouched(address_db->Get<uint64_t>(i), el_size);
+  }
+  memory_->Store(address_db, mask_db, el_size, db);
+}
+
+std::vector<uint64_t> PageTrackingMemory::GetTouchedPages() const {
+  std::vector<uint64_t> pages;
+  for (uint64_t word = 0; word < touched_.size(); word++) {
+    uint64_t bits = touched_[word];
+    while (bits != 0) {
+      int bit = __builtin_ctzll(bits);
+      bits &= bits - 1;
+      pages.push_back(((word << 6) + bit) << kPageShift);
+    }
+  }
+  return pages;
+}
+
+void PageTrackingMemory::MarkTouched(uint64_t address, uint64_t size) {
+  if (size == 0) return;
+  uint64_t first = address >> kPageShift;
+  uint64_t last = (address + size - 1) >> kPageShift;
+  for (uint64_t page = first; page <= last; page++) {
+    uint64_t index = page & (kNumPages - 1);
+    touched_[index >> 6] |= uint64_t{1} << (index & 63);
+  }
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_PAGE_TRACKING_MEMORY_H_
+#define MPACT_SIM_CODELABS_OTHER_PAGE_TRACKING_MEMORY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::Instruction;
+using ::mpact::sim::generic::ReferenceCount;
+
+// Memory interface wrapper that keeps track of which pages of the 32 bit
+// address space have been stored to. Pages that have never been stored to read
+// as zero, so the touched pages are all that is needed to capture the memory
+// contents, e.g., in a checkpoint. The wrapper doesn't own the memory.
+class PageTrackingMemory : public util::MemoryInterface {
+ public:
+  static constexpr int kPageShift = 12;
+  static constexpr uint64_t kPageSize = uint64_t{1} << kPageShift;
+  static constexpr uint64_t kNumPages = (uint64_t{1} << 32) >> kPageShift;
+
+  explicit PageTrackingMemory(util::MemoryInterface *memory);
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+  // Returns the base addresses of the touched pages in increasing order.
+  std::vector<uint64_t> GetTouchedPages() const;
+  bool IsTouched(uint64_t address) const {
+    uint64_t page = (address >> kPageShift) & (kNumPages - 1);
+    return (touched_[page >> 6] >> (page & 63)) & 1;
+  }
+  // The touched bitmap, one bit per page.
+  const uint64_t *touched_bitmap() const { return touched_.data(); }
+  // Marks the pages overlapping [address, address + size) as touched.
+  void MarkTouched(uint64_t address, uint64_t size);
+
+  util::MemoryInterface *memory() const { return memory_; }
+
+ private:
+  util::MemoryInterface *memory_;
+  // One bit per page.
+  std::vector<uint64_t> touched_;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_PAGE_TRACKING_MEMORY_H_
@@ -16,9 +16,13 @@
 #define MPACT_SIM_CODELABS_OTHER_RISCV_REGISTER_H_
 
 #include <any>
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/strings/string_view.h"
+#include "mpact/sim/generic/arch_state.h"
 #include "mpact/sim/generic/data_buffer.h"
 #include "mpact/sim/generic/operand_interface.h"
 #include "mpact/sim/generic/register.h"
@@ -38,6 +42,112 @@ using RV64Register = generic::Register<uint64_t>;
 
 using RVXRegister = RV32Register;
 
+// Integer register, whose data buffer is given to it once, when the state is
+// created (see RiscVState::xreg_value()). Data buffers submitted to it later,
+// e.g., through the generic register operands, are copied into that buffer
+// instead of replacing it, so that pointers to the value stay valid. Writes
+// to x0 are discarded.
+class RV32XRegister : public RV32Register {
+ public:
+  RV32XRegister(generic::ArchState *state, absl::string_view name)
+      : RV32Register(state, name), is_zero_(name == "x0") {}
+
+  void SetDataBuffer(generic::DataBuffer *db) override {
+    if (data_buffer() == nullptr) {
+      RV32Register::SetDataBuffer(db);
+      return;
+    }
+    if (is_zero_ || (db == data_buffer())) return;
+    data_buffer()->Set<uint32_t>(0, db->Get<uint32_t>(0));
+  }
+
+ private:
+  bool is_zero_;
+};
+
+// Operands for the integer registers that read and write the value in place,
+// through a pointer to the storage of the register's data buffer, instead of
+// replacing the data buffer on each write. RiscVState allocates the data
+// buffers of the integer registers once, and they must never be replaced
+// (see RiscVState::xreg_value()).
+class RV32XregSourceOperand : public generic::SourceOperandInterface {
+ public:
+  RV32XregSourceOperand(RV32Register *reg, const uint32_t *value,
+                        std::string op_name)
+      : register_(reg), value_(value), op_name_(std::move(op_name)) {}
+
+  uint32_t Read() const { return *value_; }
+
+  bool AsBool(int) override { return *value_ != 0; }
+  int8_t AsInt8(int) override { return static_cast<int8_t>(*value_); }
+  uint8_t AsUint8(int) override { return static_cast<uint8_t>(*value_); }
+  int16_t AsInt16(int) override { return static_cast<int16_t>(*value_); }
+  uint16_t AsUint16(int) override { return static_cast<uint16_t>(*value_); }
+  int32_t AsInt32(int) override { return static_cast<int32_t>(*value_); }
+  uint32_t AsUint32(int) override { return *value_; }
+  int64_t AsInt64(int) override { return static_cast<int32_t>(*value_); }
+  uint64_t AsUint64(int) override { return *value_; }
+  std::any GetObject() const override { return std::any(register_); }
+  std::vector<int> shape() const override { return {1}; }
+  std::string AsString() const override { return op_name_; }
+
+ private:
+  RV32Register *register_;
+  const uint32_t *value_;
+  std::string op_name_;
+};
+
+// Semantic functions that know that a destination is an integer register
+// write it with Write(), which costs a single store. Other users get a data
+// buffer, whose value is copied to the register when it is submitted. A
+// destination that is x0 writes to a scratch location instead.
+class RV32XregDestinationOperand : public generic::DestinationOperandInterface,
+                                   public generic::DataBufferDestination {
+ public:
+  RV32XregDestinationOperand(generic::ArchState *state, RV32Register *reg,
+                             uint32_t *value, int latency,
+                             std::string op_name)
+      : state_(state),
+        register_(reg),
+        value_(value),
+        latency_(latency),
+        op_name_(std::move(op_name)) {}
+
+  void Write(uint32_t value) { *value_ = value; }
+
+  // DataBufferDestination method.
+  void SetDataBuffer(generic::DataBuffer *db) override {
+    *value_ = db->Get<uint32_t>(0);
+  }
+
+  void InitializeDataBuffer(generic::DataBuffer *db) override {
+    db->set_destination(this);
+    db->set_latency(latency_);
+    db->set_delay_line(state_->data_buffer_delay_line());
+  }
+  generic::DataBuffer *CopyDataBuffer() override {
+    auto *db = AllocateDataBuffer();
+    db->Set<uint32_t>(0, *value_);
+    return db;
+  }
+  generic::DataBuffer *AllocateDataBuffer() override {
+    auto *db = state_->db_factory()->Allocate<uint32_t>(1);
+    InitializeDataBuffer(db);
+    return db;
+  }
+  int latency() const override { return latency_; }
+  std::any GetObject() const override { return std::any(register_); }
+  std::vector<int> shape() const override { return {1}; }
+  std::string AsString() const override { return op_name_; }
+
+ private:
+  generic::ArchState *state_;
+  RV32Register *register_;
+  uint32_t *value_;
+  int latency_;
+  std::string op_name_;
+};
+
 }  // namespace riscv
 }  // namespace sim
 }  // namespace mpact
@@ -14,13 +14,18 @@
 
 #include "other/riscv_simple_state.h"
 
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/log/check.h"
 #include "absl/log/log.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "mpact/sim/generic/type_helpers.h"
 #include "mpact/sim/util/memory/flat_demand_memory.h"
 #include "other/riscv_register.h"
@@ -49,6 +54,22 @@ RiscVState::RiscVState(absl::string_view id, RiscVXlen xlen,
       pc_ = pc32;
       db = db_factory()->Allocate<RV32Register::ValueType>(1);
       db->Set<uint32_t>(0, 0);
+      // Give each integer register its own data buffer, which holds its value
+      // for the lifetime of the state. The state keeps a reference to it as
+      // well, and the register never replaces it (see RV32XRegister).
+      for (int i = 0; i < 32; i++) {
+        xregs_[i] =
+            GetRegister<RV32XRegister>(absl::StrCat(kXregPrefix, i)).first;
+        xreg_dbs_[i] = db_factory()->Allocate<uint32_t>(1);
+        xreg_dbs_[i]->Set<uint32_t>(0, 0);
+        xregs_[i]->SetDataBuffer(xreg_dbs_[i]);
+        xreg_values_[i] = static_cast<uint32_t *>(xreg_dbs_[i]->raw_ptr());
+      }
+      // The csr instructions refer to a single "CSR" register. Create it here
+      // along with the other registers, so that the set of registers doesn't
+      // depend on which instructions have been decoded, e.g., when restoring
+      // a checkpoint.
+      (void)GetRegister<RV32Register>(kCsrName);
       break;
     }
     default:
@@ -64,12 +85,50 @@ RiscVState::RiscVState(absl::string_view id, RiscVXlen xlen,
 RiscVState::~RiscVState() {
   delete pc_src_operand_;
   delete pc_dst_operand_;
+  for (auto *db : xreg_dbs_) {
+    if (db != nullptr) db->DecRef();
+  }
   delete owned_memory_;
 }
 
+RV32XregSourceOperand *RiscVState::CreateXregSourceOperand(
+    int num, std::string op_name) {
+  return new RV32XregSourceOperand(xregs_[num], xreg_values_[num],
+                                   std::move(op_name));
+}
+
+RV32XregDestinationOperand *RiscVState::CreateXregDestinationOperand(
+    int num, int latency, std::string op_name) {
+  uint32_t *value = num == 0 ? &x0_scratch_ : xreg_values_[num];
+  return new RV32XregDestinationOperand(this, xregs_[num], value, latency,
+                                        std::move(op_name));
+}
+
+bool RiscVState::FillHostPageCache(uint64_t page, HostPageCacheEntry &entry) {
+  if ((host_page_lookup_ == nullptr) || (page >= kNumHostPages) ||
+      IsSlowPage(page)) {
+    return false;
+  }
+  uint8_t *host = host_page_lookup_(page << kHostPageShift);
+  if (host == nullptr) return false;
+  entry.load_page = page;
+  entry.store_page = IsStorePage(page) ? page : ~uint64_t{0};
+  entry.host = host;
+  return true;
+}
+
 void RiscVState::LoadMemory(const Instruction *inst, uint64_t address,
                             DataBuffer *db, Instruction *child_inst,
                             ReferenceCount *context) {
+  // Loads with latency are left to the memory, which schedules the child.
+  uint8_t *host = db->latency() == 0
+                      ? HostPointer(address, db->size<uint8_t>())
+                      : nullptr;
+  if (host != nullptr) {
+    std::memcpy(db->raw_ptr(), host, db->size<uint8_t>());
+    if (child_inst != nullptr) child_inst->Execute(context);
+    return;
+  }
   memory_->Load(address, db, child_inst, context);
 }
 
@@ -81,6 +140,11 @@ void RiscVState::LoadMemory(const Instruction *inst, DataBuffer *address_db,
 
 void RiscVState::StoreMemory(const Instruction *inst, uint64_t address,
                              DataBuffer *db) {
+  uint8_t *host = HostStorePointer(address, db->size<uint8_t>());
+  if (host != nullptr) {
+    std::memcpy(host, db->raw_ptr(), db->size<uint8_t>());
+    return;
+  }
   memory_->Store(address, db);
 }
 
@@ -17,6 +17,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <string>
 #include <utility>
@@ -78,6 +79,7 @@ class RiscVState : public ArchState {
   static constexpr char kVregPrefix[] = "v";
   static constexpr char kNextPcName[] = "next_pc";
   static constexpr char kPcName[] = "pc";
+  static constexpr char kCsrName[] = "CSR";
 
   RiscVState(absl::string_view id, RiscVXlen xlen,
              util::MemoryInterface *memory,
@@ -121,16 +123,66 @@ class RiscVState : public ArchState {
     return absl::OkStatus();
   }
 
+  // The integer registers. Their values are kept in the data buffers the
+  // registers are given when the state is created, which are only ever
+  // written in place, so that name based access to the registers (e.g., from
+  // the debugger, or checkpoints) and direct access through these pointers
+  // see the same values. Writes through the register operands don't replace
+  // the data buffers either (see RV32XRegister and
+  // RV32XregDestinationOperand).
+  RV32Register *xreg(int num) const { return xregs_[num]; }
+  uint32_t *xreg_value(int num) const { return xreg_values_[num]; }
+  uint32_t ReadXreg(int num) const { return *xreg_values_[num]; }
+  void WriteXreg(int num, uint32_t value) {
+    if (num != 0) *xreg_values_[num] = value;
+  }
+  // Operands for the integer registers. Writes to x0 are discarded.
+  RV32XregSourceOperand *CreateXregSourceOperand(int num,
+                                                 std::string op_name);
+  RV32XregDestinationOperand *CreateXregDestinationOperand(
+      int num, int latency, std::string op_name);
+
   // Methods called by instruction semantic functions to load from memory.
   void LoadMemory(const Instruction *inst, uint64_t address, DataBuffer *db,
                   Instruction *child_inst, ReferenceCount *context);
   void LoadMemory(const Instruction *inst, DataBuffer *address_db,
                   DataBuffer *mask_db, int el_size, DataBuffer *db,
                   Instruction *child_inst, ReferenceCount *context);
+  // Loads and returns a value in a single step, for memories that complete
+  // loads synchronously. Plain ram is read directly, and only accesses that
+  // have to go through the memory interface allocate a data buffer.
+  template <typename T>
+  T LoadMemory(const Instruction *inst, uint64_t address) {
+    T value;
+    if (uint8_t *host = HostPointer(address, sizeof(T))) {
+      std::memcpy(&value, host, sizeof(T));
+      return value;
+    }
+    auto *db = db_factory()->Allocate<T>(1);
+    db->set_latency(0);
+    memory_->Load(address, db, nullptr, nullptr);
+    value = db->template Get<T>(0);
+    db->DecRef();
+    return value;
+  }
   // Methods called by instruction semantic functions to store to memory.
   void StoreMemory(const Instruction *inst, uint64_t address, DataBuffer *db);
   void StoreMemory(const Instruction *inst, DataBuffer *address_db,
                    DataBuffer *mask_db, int el_size, DataBuffer *db);
+  // Stores a value without the caller having to allocate a data buffer. Plain
+  // ram is written directly, and only accesses that have to go through the
+  // memory interface (semihosting, watchpoints, etc.) allocate one.
+  template <typename T>
+  void StoreMemory(const Instruction *inst, uint64_t address, T value) {
+    if (uint8_t *host = HostStorePointer(address, sizeof(T))) {
+      std::memcpy(host, &value, sizeof(T));
+      return;
+    }
+    auto *db = db_factory()->Allocate<T>(1);
+    db->template Set<T>(0, value);
+    memory_->Store(address, db);
+    db->DecRef();
+  }
   // Called by the fence instruction semantic function to signal a fence
   // operation.
   void Fence(const Instruction *inst, int fm, int predecessor, int successor);
@@ -150,6 +202,78 @@ class RiscVState : public ArchState {
     on_ebreak_.emplace_back(std::move(handler));
   }
 
+  // Direct access to guest memory that is backed by host memory. A bit set in
+  // slow_pages marks a page whose accesses must go through the memory
+  // interface, e.g., because it is memory mapped io or watched. Stores only
+  // take the fast path to pages whose bit is set in store_pages. Both bitmaps
+  // have one bit per host page, and are owned by the caller.
+  static constexpr int kHostPageShift = 12;
+  static constexpr uint64_t kHostPageSize = uint64_t{1} << kHostPageShift;
+  static constexpr uint64_t kNumHostPages = (uint64_t{1} << 32) >>
+                                            kHostPageShift;
+  // Returns the host address of the page that holds the guest address, or
+  // nullptr if there is none (yet).
+  using HostPageLookup = absl::AnyInvocable<uint8_t *(uint64_t address)>;
+
+  // Memory backed by contiguous host memory: guest address a is at
+  // host_base + a. A null host_base disables the fast path.
+  void set_host_memory(uint8_t *host_base, const uint64_t *slow_pages,
+                       const uint64_t *store_pages) {
+    host_base_ = host_base;
+    slow_pages_ = slow_pages;
+    store_pages_ = store_pages;
+    FlushHostPageCache();
+  }
+  // Memory backed by host pages that are found by the lookup. The host
+  // address of recently accessed pages is kept in a small direct mapped cache,
+  // so that most accesses don't need the lookup.
+  void set_host_pages(HostPageLookup lookup, const uint64_t *slow_pages,
+                      const uint64_t *store_pages) {
+    host_base_ = nullptr;
+    host_page_lookup_ = std::move(lookup);
+    slow_pages_ = slow_pages;
+    store_pages_ = store_pages;
+    FlushHostPageCache();
+  }
+  // Must be called when the slow or store pages change, or a host page is
+  // released.
+  void FlushHostPageCache() {
+    for (auto &entry : host_page_cache_) entry = HostPageCacheEntry();
+  }
+
+  // Returns the host address of [address, address + size) if it can be loaded
+  // directly, or nullptr if it has to go through the memory interface.
+  uint8_t *HostPointer(uint64_t address, int size) {
+    uint64_t page = address >> kHostPageShift;
+    // Accesses that cross a page boundary take the slow path.
+    if (((address + size - 1) >> kHostPageShift) != page) return nullptr;
+    if (host_base_ != nullptr) {
+      if ((page >= kNumHostPages) || IsSlowPage(page)) return nullptr;
+      return host_base_ + address;
+    }
+    auto &entry = host_page_cache_[page & (kHostPageCacheSize - 1)];
+    if (entry.load_page != page) {
+      if (!FillHostPageCache(page, entry)) return nullptr;
+    }
+    return entry.host + (address & (kHostPageSize - 1));
+  }
+  // Same as above for stores.
+  uint8_t *HostStorePointer(uint64_t address, int size) {
+    uint64_t page = address >> kHostPageShift;
+    if (((address + size - 1) >> kHostPageShift) != page) return nullptr;
+    if (host_base_ != nullptr) {
+      if ((page >= kNumHostPages) || IsSlowPage(page)) return nullptr;
+      if (!IsStorePage(page)) return nullptr;
+      return host_base_ + address;
+    }
+    auto &entry = host_page_cache_[page & (kHostPageCacheSize - 1)];
+    if (entry.store_page != page) {
+      if (!FillHostPageCache(page, entry)) return nullptr;
+      if (entry.store_page != page) return nullptr;
+    }
+    return entry.host + (address & (kHostPageSize - 1));
+  }
+
   // Accessors.
   void set_memory(util::MemoryInterface *memory) { memory_ = memory; }
   util::MemoryInterface *memory() const { return memory_; }
@@ -191,9 +315,39 @@ class RiscVState : public ArchState {
   generic::SourceOperandInterface *pc_src_operand_ = nullptr;
   generic::DestinationOperandInterface *pc_dst_operand_ = nullptr;
   int flen_ = 0;
+  // Integer registers, their data buffers, and pointers to their values.
+  RV32Register *xregs_[32] = {};
+  DataBuffer *xreg_dbs_[32] = {};
+  uint32_t *xreg_values_[32] = {};
+  // Destination of writes to x0.
+  uint32_t x0_scratch_ = 0;
   util::FlatDemandMemory *owned_memory_ = nullptr;
   util::MemoryInterface *memory_ = nullptr;
   util::AtomicMemoryOpInterface *atomic_memory_ = nullptr;
+  // Host memory fast path.
+  static constexpr int kHostPageCacheSize = 64;
+  // The page number tags are invalid until the entry is filled. The store tag
+  // is only set if stores to the page may take the fast path.
+  struct HostPageCacheEntry {
+    uint64_t load_page = ~uint64_t{0};
+    uint64_t store_page = ~uint64_t{0};
+    uint8_t *host = nullptr;
+  };
+  bool IsSlowPage(uint64_t page) const {
+    return (slow_pages_[page >> 6] >> (page & 63)) & 1;
+  }
+  bool IsStorePage(uint64_t page) const {
+    return (store_pages_[page >> 6] >> (page & 63)) & 1;
+  }
+  // Fills the cache entry for the page. Returns false if the page can't be
+  // accessed directly.
+  bool FillHostPageCache(uint64_t page, HostPageCacheEntry &entry);
+
+  uint8_t *host_base_ = nullptr;
+  HostPageLookup host_page_lookup_;
+  const uint64_t *slow_pages_ = nullptr;
+  const uint64_t *store_pages_ = nullptr;
+  HostPageCacheEntry host_page_cache_[kHostPageCacheSize];
   std::vector<absl::AnyInvocable<bool(const Instruction *)>> on_ebreak_;
   absl::AnyInvocable<bool(const Instruction *)> on_ecall_;
   absl::AnyInvocable<bool(bool, uint64_t, uint64_t, uint64_t,
@@ -0,0 +1,88 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/riscv_simple_state.h"
+
+#include <cstdint>
+
+#include "googletest/include/gtest/gtest.h"
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/operand_interface.h"
+#include "other/riscv_register.h"
+
+namespace {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::DestinationOperandInterface;
+using ::mpact::sim::riscv::RiscVState;
+using ::mpact::sim::riscv::RiscVXlen;
+using ::mpact::sim::riscv::RV32Register;
+
+// Writes the value to the register through a generic register operand, which
+// submits a data buffer to the register.
+void WriteThroughGenericOperand(RV32Register *reg, uint32_t value) {
+  DestinationOperandInterface *operand = reg->CreateDestinationOperand(0);
+  DataBuffer *db = operand->AllocateDataBuffer();
+  db->Set<uint32_t>(0, value);
+  db->Submit();
+  delete operand;
+}
+
+TEST(RiscVSimpleStateTest, GenericRegisterWriteIsSeenByReadXreg) {
+  RiscVState state("test", RiscVXlen::RV32, nullptr);
+  auto *x5 = state.GetRegister<RV32Register>("x5").first;
+  DataBuffer *db = x5->data_buffer();
+  uint32_t *value = state.xreg_value(5);
+  WriteThroughGenericOperand(x5, 0x1234'5678);
+  EXPECT_EQ(state.ReadXreg(5), 0x1234'5678u);
+  // The register keeps its data buffer, so the value pointer stays valid.
+  EXPECT_EQ(x5->data_buffer(), db);
+  EXPECT_EQ(state.xreg_value(5), value);
+  EXPECT_EQ(*value, 0x1234'5678u);
+  // Writes in place are seen through the register.
+  state.WriteXreg(5, 0xabcd);
+  EXPECT_EQ(x5->data_buffer()->Get<uint32_t>(0), 0xabcdu);
+}
+
+TEST(RiscVSimpleStateTest, XregOperandsShareTheRegisterValue) {
+  RiscVState state("test", RiscVXlen::RV32, nullptr);
+  auto *x7 = state.GetRegister<RV32Register>("x7").first;
+  auto *source = state.CreateXregSourceOperand(7, "x7");
+  auto *destination = state.CreateXregDestinationOperand(7, 0, "x7");
+  destination->Write(42);
+  EXPECT_EQ(source->Read(), 42u);
+  EXPECT_EQ(x7->data_buffer()->Get<uint32_t>(0), 42u);
+  // A data buffer submitted to the in place operand is copied as well.
+  DataBuffer *db = destination->AllocateDataBuffer();
+  db->Set<uint32_t>(0, 43);
+  db->Submit();
+  EXPECT_EQ(state.ReadXreg(7), 43u);
+  WriteThroughGenericOperand(x7, 44);
+  EXPECT_EQ(source->Read(), 44u);
+  delete source;
+  delete destination;
+}
+
+TEST(RiscVSimpleStateTest, WritesToX0AreDiscarded) {
+  RiscVState state("test", RiscVXlen::RV32, nullptr);
+  auto *x0 = state.GetRegister<RV32Register>("x0").first;
+  WriteThroughGenericOperand(x0, 1);
+  EXPECT_EQ(state.ReadXreg(0), 0u);
+  auto *destination = state.CreateXregDestinationOperand(0, 0, "x0");
+  destination->Write(2);
+  EXPECT_EQ(state.ReadXreg(0), 0u);
+  delete destination;
+}
+
+}  // namespace
@@ -0,0 +1,282 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/rv32i_inplace_instructions.h"
+
+#include <cstdint>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/instruction_helpers.h"
+#include "other/riscv_register.h"
+#include "other/riscv_simple_state.h"
+#include "riscv_isa_decoder/solution/riscv32i_enums.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using generic::DataBuffer;
+using riscv::RiscVState;
+using riscv::RV32XregDestinationOperand;
+
+static inline void WriteRd(Instruction *instruction, int index,
+                           uint32_t value) {
+  static_cast<RV32XregDestinationOperand *>(instruction->Destination(index))
+      ->Write(value);
+}
+
+// Same as generic::BinaryOp and generic::UnaryOp, but writes the result with
+// WriteRd.
+template <typename Result, typename Argument1 = Result,
+          typename Argument2 = Argument1, typename Operation>
+static inline void RdBinaryOp(Instruction *instruction, Operation op) {
+  Argument1 a = generic::GetInstructionSource<Argument1>(instruction, 0);
+  Argument2 b = generic::GetInstructionSource<Argument2>(instruction, 1);
+  WriteRd(instruction, 0, static_cast<uint32_t>(static_cast<Result>(op(a, b))));
+}
+
+template <typename Result, typename Argument = Result, typename Operation>
+static inline void RdUnaryOp(Instruction *instruction, Operation op) {
+  Argument a = generic::GetInstructionSource<Argument>(instruction, 0);
+  WriteRd(instruction, 0, static_cast<uint32_t>(static_cast<Result>(op(a))));
+}
+
+void RV32IAddInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(instruction,
+                       [](uint32_t a, uint32_t b) { return a + b; });
+}
+
+void RV32IAndInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(instruction,
+                       [](uint32_t a, uint32_t b) { return a & b; });
+}
+
+void RV32IOrInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(instruction,
+                       [](uint32_t a, uint32_t b) { return a | b; });
+}
+
+void RV32ISllInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(
+      instruction, [](uint32_t a, uint32_t b) { return a << (b & 0x1f); });
+}
+
+void RV32ISltuInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(
+      instruction, [](uint32_t a, uint32_t b) { return (a < b) ? 1 : 0; });
+}
+
+void RV32ISraInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t, int32_t, uint32_t>(
+      instruction, [](int32_t a, uint32_t b) { return a >> (b & 0x1f); });
+}
+
+void RV32ISrlInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(
+      instruction, [](uint32_t a, uint32_t b) { return a >> (b & 0x1f); });
+}
+
+void RV32ISubInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(instruction,
+                       [](uint32_t a, uint32_t b) { return a - b; });
+}
+
+void RV32IXorInPlace(Instruction *instruction) {
+  RdBinaryOp<uint32_t>(instruction,
+                       [](uint32_t a, uint32_t b) { return a ^ b; });
+}
+
+void RV32ILuiInPlace(Instruction *instruction) {
+  RdUnaryOp<uint32_t>(instruction, [](uint32_t a) { return a; });
+}
+
+void RV32IAuipcInPlace(Instruction *instruction) {
+  RdUnaryOp<uint32_t>(instruction, [instruction](uint32_t a) {
+    return a + instruction->address();
+  });
+}
+
+// The pc is still written with a data buffer, as the core detects a control
+// transfer by the pc data buffer changing.
+void RV32IJalInPlace(Instruction *instruction) {
+  uint32_t offset = instruction->Source(0)->AsUint32(0);
+  uint32_t target = offset + instruction->address();
+  uint32_t return_address = instruction->address() + instruction->size();
+  DataBuffer *db = instruction->Destination(0)->AllocateDataBuffer();
+  db->Set<uint32_t>(0, target);
+  db->Submit();
+  WriteRd(instruction, 1, return_address);
+}
+
+void RV32IJalrInPlace(Instruction *instruction) {
+  uint32_t reg_base = instruction->Source(0)->AsUint32(0);
+  uint32_t offset = instruction->Source(1)->AsUint32(0);
+  uint32_t target = offset + reg_base;
+  uint32_t return_address = instruction->address() + instruction->size();
+  DataBuffer *db = instruction->Destination(0)->AllocateDataBuffer();
+  db->Set<uint32_t>(0, target);
+  db->Submit();
+  WriteRd(instruction, 1, return_address);
+}
+
+// The load is done by the parent instruction, which writes rd of the child.
+template <typename ValueType>
+static inline void LoadValueFusedInPlace(Instruction *instruction) {
+  auto base = generic::GetInstructionSource<uint32_t>(instruction, 0);
+  auto offset = generic::GetInstructionSource<uint32_t>(instruction, 1);
+  uint32_t address = base + offset;
+  auto *state = static_cast<RiscVState *>(instruction->state());
+  auto value = state->LoadMemory<ValueType>(instruction, address);
+  WriteRd(instruction->child(), 0, static_cast<uint32_t>(value));
+}
+
+void RV32ILbFusedInPlace(Instruction *instruction) {
+  LoadValueFusedInPlace<int8_t>(instruction);
+}
+
+void RV32ILbuFusedInPlace(Instruction *instruction) {
+  LoadValueFusedInPlace<uint8_t>(instruction);
+}
+
+void RV32ILhFusedInPlace(Instruction *instruction) {
+  LoadValueFusedInPlace<int16_t>(instruction);
+}
+
+void RV32ILhuFusedInPlace(Instruction *instruction) {
+  LoadValueFusedInPlace<uint16_t>(instruction);
+}
+
+void RV32ILwFusedInPlace(Instruction *instruction) {
+  LoadValueFusedInPlace<uint32_t>(instruction);
+}
+
+template <typename ValueType>
+static inline void StoreValueInPlace(Instruction *instruction) {
+  auto base = generic::GetInstructionSource<uint32_t>(instruction, 0);
+  auto offset = generic::GetInstructionSource<uint32_t>(instruction, 1);
+  uint32_t address = base + offset;
+  auto value = generic::GetInstructionSource<ValueType>(instruction, 2);
+  auto *state = static_cast<RiscVState *>(instruction->state());
+  state->StoreMemory<ValueType>(instruction, address, value);
+}
+
+void RV32ISbInPlace(Instruction *instruction) {
+  StoreValueInPlace<uint8_t>(instruction);
+}
+
+void RV32IShInPlace(Instruction *instruction) {
+  StoreValueInPlace<uint16_t>(instruction);
+}
+
+void RV32ISwInPlace(Instruction *instruction) {
+  StoreValueInPlace<uint32_t>(instruction);
+}
+
+void UseInPlaceSemanticFunction(Instruction *instruction) {
+  void (*function)(Instruction *) = nullptr;
+  // The instruction that has the rd destination, and its index.
+  Instruction *rd_instruction = instruction;
+  int rd = 0;
+  switch (static_cast<OpcodeEnum>(instruction->opcode())) {
+    case OpcodeEnum::kAdd:
+    case OpcodeEnum::kAddi:
+      function = RV32IAddInPlace;
+      break;
+    case OpcodeEnum::kAnd:
+    case OpcodeEnum::kAndi:
+      function = RV32IAndInPlace;
+      break;
+    case OpcodeEnum::kOr:
+    case OpcodeEnum::kOri:
+      function = RV32IOrInPlace;
+      break;
+    case OpcodeEnum::kSll:
+    case OpcodeEnum::kSlli:
+      function = RV32ISllInPlace;
+      break;
+    case OpcodeEnum::kSltu:
+      function = RV32ISltuInPlace;
+      break;
+    case OpcodeEnum::kSub:
+      function = RV32ISubInPlace;
+      break;
+    case OpcodeEnum::kSrai:
+      function = RV32ISraInPlace;
+      break;
+    case OpcodeEnum::kSrli:
+      function = RV32ISrlInPlace;
+      break;
+    case OpcodeEnum::kXor:
+    case OpcodeEnum::kXori:
+      function = RV32IXorInPlace;
+      break;
+    case OpcodeEnum::kLui:
+      function = RV32ILuiInPlace;
+      break;
+    case OpcodeEnum::kAuipc:
+      function = RV32IAuipcInPlace;
+      break;
+    case OpcodeEnum::kJal:
+      function = RV32IJalInPlace;
+      rd = 1;
+      break;
+    case OpcodeEnum::kJalr:
+      function = RV32IJalrInPlace;
+      rd = 1;
+      break;
+    case OpcodeEnum::kLb:
+      function = RV32ILbFusedInPlace;
+      rd_instruction = instruction->child();
+      break;
+    case OpcodeEnum::kLbu:
+      function = RV32ILbuFusedInPlace;
+      rd_instruction = instruction->child();
+      break;
+    case OpcodeEnum::kLh:
+      function = RV32ILhFusedInPlace;
+      rd_instruction = instruction->child();
+      break;
+    case OpcodeEnum::kLhu:
+      function = RV32ILhuFusedInPlace;
+      rd_instruction = instruction->child();
+      break;
+    case OpcodeEnum::kLw:
+      function = RV32ILwFusedInPlace;
+      rd_instruction = instruction->child();
+      break;
+    // Stores don't write rd.
+    case OpcodeEnum::kSb:
+      instruction->set_semantic_function(RV32ISbInPlace);
+      return;
+    case OpcodeEnum::kSh:
+      instruction->set_semantic_function(RV32IShInPlace);
+      return;
+    case OpcodeEnum::kSw:
+      instruction->set_semantic_function(RV32ISwInPlace);
+      return;
+    default:
+      return;
+  }
+  if (rd_instruction == nullptr) return;
+  if (rd_instruction->DestinationsSize() <= rd) return;
+  auto *destination = dynamic_cast<RV32XregDestinationOperand *>(
+      rd_instruction->Destination(rd));
+  if ((destination == nullptr) || (destination->latency() != 0)) return;
+  instruction->set_semantic_function(function);
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_RV32I_INPLACE_INSTRUCTIONS_H_
+#define MPACT_SIM_CODELABS_OTHER_RV32I_INPLACE_INSTRUCTIONS_H_
+
+#include "mpact/sim/generic/instruction.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::Instruction;
+
+// Versions of the RV32I semantic functions in
+// riscv_semantic_functions/solution/rv32i_instructions.h that write rd in
+// place, through riscv::RV32XregDestinationOperand::Write(), instead of
+// allocating and submitting a data buffer. They may only be used for
+// instructions whose rd destination is such an operand, with latency 0.
+//
+// The loads replace the semantic function of the parent of the two stage
+// loads. They load the value synchronously, and write it to the rd
+// destination of the child instruction, which is then never executed. The
+// stores write memory through RiscVState::StoreMemory<T>, without allocating
+// a data buffer.
+
+void RV32IAddInPlace(Instruction *instruction);
+void RV32IAndInPlace(Instruction *instruction);
+void RV32IOrInPlace(Instruction *instruction);
+void RV32ISllInPlace(Instruction *instruction);
+void RV32ISltuInPlace(Instruction *instruction);
+void RV32ISubInPlace(Instruction *instruction);
+void RV32ISraInPlace(Instruction *instruction);
+void RV32ISrlInPlace(Instruction *instruction);
+void RV32IXorInPlace(Instruction *instruction);
+void RV32ILuiInPlace(Instruction *instruction);
+void RV32IAuipcInPlace(Instruction *instruction);
+void RV32IJalInPlace(Instruction *instruction);
+void RV32IJalrInPlace(Instruction *instruction);
+void RV32ILbFusedInPlace(Instruction *instruction);
+void RV32ILbuFusedInPlace(Instruction *instruction);
+void RV32ILhFusedInPlace(Instruction *instruction);
+void RV32ILhuFusedInPlace(Instruction *instruction);
+void RV32ILwFusedInPlace(Instruction *instruction);
+void RV32ISbInPlace(Instruction *instruction);
+void RV32IShInPlace(Instruction *instruction);
+void RV32ISwInPlace(Instruction *instruction);
+
+// Replaces the semantic function of a newly decoded instruction with its in
+// place version, if it has one and the rd destination of the instruction (or
+// of its child, for loads) allows it. The check is done once here, so that the
+// semantic functions don't have to check on each write.
+void UseInPlaceSemanticFunction(Instruction *instruction);
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_RV32I_INPLACE_INSTRUCTIONS_H_
@@ -0,0 +1,138 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/rv32i_multi_hart_top.h"
+
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT: third_party code.
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "other/shared_memory.h"
+#include "other/rv32i_top.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+RV32IMultiHartTop::RV32IMultiHartTop(std::string name, int num_harts)
+    : Component(name) {
+  memory_ = new SharedMemory();
+  for (int i = 0; i < num_harts; i++) {
+    auto *hart = new RV32ITop(absl::StrCat("hart", i), memory_);
+    CHECK_OK(AddChildComponent(*hart));
+    CHECK_OK(hart->WriteRegister("a0", i));
+    harts_.push_back(hart);
+  }
+}
+
+RV32IMultiHartTop::~RV32IMultiHartTop() {
+  (void)Halt();
+  (void)Wait();
+  for (auto *hart : harts_) delete hart;
+  harts_.clear();
+  delete memory_;
+}
+
+absl::Status RV32IMultiHartTop::Run() {
+  if (!threads_.empty()) {
+    return absl::FailedPreconditionError(
+        "RV32IMultiHartTop::Run: harts are already running");
+  }
+  stop_.store(false, std::memory_order_relaxed);
+  for (int i = 0; i < num_harts(); i++) {
+    threads_.emplace_back([this, i]() { RunHart(i); });
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RV32IMultiHartTop::Wait() {
+  for (auto &thread : threads_) thread.join();
+  threads_.clear();
+  return absl::OkStatus();
+}
+
+absl::Status RV32IMultiHartTop::Halt() {
+  if (threads_.empty()) return absl::OkStatus();
+  // A hart that is between quanta sees the stop flag at the barrier, the
+  // others are halted right away.
+  stop_.store(true, std::memory_order_relaxed);
+  for (auto *hart : harts_) (void)hart->Halt();
+  return absl::OkStatus();
+}
+
+absl::Status RV32IMultiHartTop::SetPc(uint64_t value) {
+  for (auto *hart : harts_) {
+    auto status = hart->WriteRegister("pc", value);
+    if (!status.ok()) return status;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RV32IMultiHartTop::SetUpSemiHosting(
+    const SemiHostAddresses &magic) {
+  for (auto *hart : harts_) {
+    auto status = hart->SetUpSemiHosting(magic);
+    if (!status.ok()) return status;
+  }
+  return absl::OkStatus();
+}
+
+void RV32IMultiHartTop::RunHart(int index) {
+  auto *hart = harts_[index];
+  bool stop;
+  do {
+    hart->set_instruction_limit(quantum_);
+    auto status = hart->RunToHalt();
+    if (!status.ok()) {
+      LOG(ERROR) << hart->component_name() << ": " << status.message();
+      stop = true;
+    } else {
+      // Any halt other than the end of the quantum stops all the harts.
+      auto halt_reason = hart->GetLastHaltReason();
+      stop = !halt_reason.ok() ||
+             (halt_reason.value() != *RV32ITop::kInstructionLimitHaltReason);
+    }
+    stop = Barrier(stop);
+  } while (!stop);
+  hart->set_instruction_limit(0);
+}
+
+bool RV32IMultiHartTop::Barrier(bool stop) {
+  absl::MutexLock lock(&barrier_mutex_);
+  barrier_stop_ |= stop;
+  uint64_t generation = barrier_generation_;
+  if (++barrier_count_ == num_harts()) {
+    // Last hart to arrive. Decide for all harts whether to stop, so that they
+    // all make the same decision.
+    barrier_result_ = barrier_stop_ || stop_.load(std::memory_order_relaxed);
+    barrier_stop_ = false;
+    barrier_count_ = 0;
+    barrier_generation_++;
+    barrier_cv_.SignalAll();
+    return barrier_result_;
+  }
+  while (generation == barrier_generation_) {
+    barrier_cv_.Wait(&barrier_mutex_);
+  }
+  return barrier_result_;
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_RV32I_MULTI_HART_TOP_H_
+#define MPACT_SIM_CODELABS_OTHER_RV32I_MULTI_HART_TOP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT: third_party code.
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "mpact/sim/generic/component.h"
+#include "mpact/sim/generic/core_debug_interface.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+#include "other/shared_memory.h"
+#include "other/rv32i_top.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Top level class for a multi-hart RiscV32I simulator. Each hart is an RV32ITop
+// with its own state, decode cache and debug interface, and all harts share a
+// single memory. When running, each hart executes on its own host thread. The
+// harts execute a quantum of instructions, then wait for each other at a
+// barrier before starting the next quantum, so that no hart gets more than one
+// quantum ahead of the others. Smaller quanta give tighter interleaving of the
+// harts' memory accesses, at the cost of more synchronization.
+//
+// At reset, register a0 of each hart holds its hart id.
+class RV32IMultiHartTop : public generic::Component {
+ public:
+  using SemiHostAddresses = RV32ITop::SemiHostAddresses;
+
+  static constexpr uint64_t kDefaultQuantum = 10'000;
+
+  RV32IMultiHartTop(std::string name, int num_harts);
+  ~RV32IMultiHartTop() override;
+
+  // Starts all harts. The harts run until one of them halts for any reason
+  // other than reaching the end of its quantum, or until Halt() is called.
+  absl::Status Run();
+  // Waits until all harts have stopped.
+  absl::Status Wait();
+  // Requests all harts to stop.
+  absl::Status Halt();
+
+  // Sets the pc of every hart.
+  absl::Status SetPc(uint64_t value);
+  // Set up semihosting with the given magic addresses on every hart.
+  absl::Status SetUpSemiHosting(const SemiHostAddresses &magic);
+
+  // Accessors.
+  int num_harts() const { return harts_.size(); }
+  RV32ITop *hart(int index) const { return harts_[index]; }
+  // Each hart provides its own debug interface.
+  generic::CoreDebugInterface *debug_interface(int index) const {
+    return harts_[index];
+  }
+  // Memory shared by all harts.
+  util::MemoryInterface *memory() const { return memory_; }
+  void set_quantum(uint64_t value) { quantum_ = value; }
+  uint64_t quantum() const { return quantum_; }
+
+ private:
+  // Host thread body for the given hart.
+  void RunHart(int index);
+  // Waits until all harts reach the barrier. Returns true if the harts
+  // should stop, i.e., if any hart passed in true, or Halt() was called.
+  bool Barrier(bool stop);
+
+  SharedMemory *memory_ = nullptr;
+  std::vector<RV32ITop *> harts_;
+  std::vector<std::thread> threads_;
+  uint64_t quantum_ = kDefaultQuantum;
+  // Set when all harts should stop at the end of the current quantum.
+  std::atomic<bool> stop_ = false;
+  // Barrier state.
+  absl::Mutex barrier_mutex_;
+  absl::CondVar barrier_cv_;
+  int barrier_count_ = 0;
+  uint64_t barrier_generation_ = 0;
+  bool barrier_stop_ = false;
+  bool barrier_result_ = false;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_RV32I_MULTI_HART_TOP_H_
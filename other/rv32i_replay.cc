@@ -0,0 +1,87 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays a binary instruction trace written by rv32i_sim --trace_file, and
+// writes the resulting counters to <output_dir>/<trace basename>.proto, in
+// the same format as rv32i_sim.
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "mpact/sim/proto/component_data.pb.h"
+#include "other/trace_reader.h"
+#include "other/trace_replay.h"
+#include "src/google/protobuf/text_format.h"
+
+using ::mpact::sim::codelab::TraceReader;
+using ::mpact::sim::codelab::TraceReplay;
+using ::mpact::sim::proto::ComponentData;
+
+ABSL_FLAG(std::string, output_dir, "", "Output directory");
+
+// Returns the file name without directory and extensions.
+static std::string GetBasename(const std::string &full_file_name) {
+  std::string file_name =
+      full_file_name.substr(full_file_name.find_last_of('/') + 1);
+  return file_name.substr(0, file_name.find_first_of('.'));
+}
+
+int main(int argc, char **argv) {
+  auto arg_vec = absl::ParseCommandLine(argc, argv);
+  if (arg_vec.size() != 2) {
+    std::cerr << "Usage: rv32i_replay [--output_dir=<dir>] <trace file>"
+              << std::endl;
+    return -1;
+  }
+  auto res = TraceReader::Open(arg_vec[1]);
+  if (!res.ok()) {
+    std::cerr << res.status().message() << std::endl;
+    return -1;
+  }
+  std::unique_ptr<TraceReader> reader(res.value());
+  std::string file_basename = GetBasename(arg_vec[1]);
+  TraceReplay replay(file_basename);
+  auto status = replay.Replay(reader.get());
+  if (!status.ok()) {
+    std::cerr << status.message() << std::endl;
+  }
+
+  // Export counters, including those of a partially replayed trace.
+  auto component_proto = std::make_unique<ComponentData>();
+  CHECK_OK(replay.Export(component_proto.get())) << "Failed to export proto";
+  std::string proto_file_name;
+  if (absl::GetFlag(FLAGS_output_dir).empty()) {
+    proto_file_name = "./" + file_basename + ".proto";
+  } else {
+    proto_file_name =
+        absl::GetFlag(FLAGS_output_dir) + "/" + file_basename + ".proto";
+  }
+  std::fstream proto_file(proto_file_name.c_str(), std::ios_base::out);
+  std::string serialized;
+  if (!proto_file.good() ||
+      !google::protobuf::TextFormat::PrintToString(*component_proto,
+                                                   &serialized)) {
+    LOG(ERROR) << "Failed to write proto to file";
+  } else {
+    proto_file << serialized;
+    proto_file.close();
+  }
+  return status.ok() ? 0 : -1;
+}
@@ -14,27 +14,48 @@
 
 #include <signal.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <string>
+#include <thread>  // NOLINT: third_party code.
+#include <utility>
 #include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/log/log.h"
 #include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "elfio/elfio.hpp"
+#include "mpact/sim/generic/counters.h"
 #include "mpact/sim/generic/data_buffer.h"
 #include "mpact/sim/proto/component_data.pb.h"
 #include "mpact/sim/util/memory/memory_watcher.h"
 #include "mpact/sim/util/program_loader/elf_program_loader.h"
+#include "other/adaptive_decode_cache.h"
+#include "other/interval_driver.h"
+#include "other/rv32i_multi_hart_top.h"
 #include "other/rv32i_top.h"
+#include "other/trace_writer.h"
 #include "riscv/debug_command_shell.h"
 #include "riscv/riscv32_htif_semihost.h"
 #include "src/google/protobuf/text_format.h"
 
+using ::mpact::sim::codelab::AdaptiveDecodeCache;
+using ::mpact::sim::codelab::IntervalDriver;
+using ::mpact::sim::codelab::RV32IMultiHartTop;
+using ::mpact::sim::codelab::RV32ITop;
+using ::mpact::sim::codelab::TraceWriter;
 using ::mpact::sim::proto::ComponentData;
 using ::mpact::sim::riscv::RiscV32HtifSemiHost;
 using AddressRange = mpact::sim::util::MemoryWatcher::AddressRange;
@@ -44,20 +65,155 @@ ABSL_FLAG(bool, i, false, "Interactive mode");
 ABSL_FLAG(bool, interactive, false, "Interactive mode");
 // Flag for destination directory of proto file.
 ABSL_FLAG(std::string, output_dir, "", "Output directory");
+// Flag for selecting the threaded interpreter.
+ABSL_FLAG(bool, threaded, false, "Use the direct-threaded interpreter");
+// Flag for how often (in instructions) counters are updated while running.
+ABSL_FLAG(uint64_t, counter_publish_interval, 0,
+          "Counter update interval while running (0 - only when halted)");
+// Flag for limiting the number of instructions executed.
+ABSL_FLAG(uint64_t, max_instructions, 0,
+          "Maximum number of instructions to execute (0 - no limit)");
+// Flags for multi-hart simulation.
+ABSL_FLAG(int, harts, 1, "Number of harts sharing the memory");
+ABSL_FLAG(uint64_t, hart_quantum, RV32IMultiHartTop::kDefaultQuantum,
+          "Number of instructions each hart executes between synchronizations");
+// Flag for recording an instruction trace.
+ABSL_FLAG(std::string, trace_file, "", "Instruction trace output file");
+// Flags for checkpoints.
+ABSL_FLAG(std::string, restore_checkpoint, "",
+          "Checkpoint file to restore before starting the simulation");
+ABSL_FLAG(std::string, save_checkpoint, "",
+          "Checkpoint file to save when the simulation ends");
+// Flags for parallel interval simulation.
+ABSL_FLAG(uint64_t, interval_instructions, 0,
+          "Re-simulate the run in parallel intervals of this many "
+          "instructions (0 - disabled)");
+ABSL_FLAG(int, interval_threads, 0,
+          "Number of interval simulation threads (0 - one per host cpu)");
+// Flags for sampled simulation.
+ABSL_FLAG(uint64_t, ff_instructions, 0,
+          "Number of instructions to fast forward between detailed windows "
+          "(0 - disabled)");
+ABSL_FLAG(uint64_t, window_instructions, 10'000,
+          "Number of instructions in each detailed window");
+// Flags for batch mode.
+ABSL_FLAG(std::string, batch_manifest, "",
+          "Simulate each elf file listed (one per line) in the given file");
+ABSL_FLAG(int, batch_threads, 0,
+          "Number of batch simulation threads (0 - one per host cpu)");
+ABSL_FLAG(bool, host_memory, false,
+          "Back simulated memory by a single host memory reservation, so that "
+          "loads and stores access it directly (single hart only)");
+ABSL_FLAG(bool, flat_memory, false,
+          "Use util::FlatDemandMemory for simulated memory, so that all loads "
+          "and stores go through the memory interface (single hart only)");
+ABSL_FLAG(bool, mmap_elf, false,
+          "Map the program's segments copy-on-write into simulated memory "
+          "instead of copying them (single hart only)");
+// Flags for predecoding the program.
+ABSL_FLAG(bool, predecode, false,
+          "Decode the executable segments of the program before running it");
+ABSL_FLAG(int, predecode_threads, 0,
+          "Number of threads used to predecode (0 - one per host cpu)");
+// Flags for the decode cache geometry.
+ABSL_FLAG(int, decode_cache_entries,
+          AdaptiveDecodeCache::Options().num_entries,
+          "Initial number of decode cache entries");
+ABSL_FLAG(int, decode_cache_min_pc_increment,
+          AdaptiveDecodeCache::Options().minimum_pc_increment,
+          "Minimum pc increment between decode cache entries");
+ABSL_FLAG(int, decode_cache_max_entries,
+          AdaptiveDecodeCache::Options().max_entries,
+          "Number of entries the decode cache may grow to when it thrashes "
+          "(not larger than decode_cache_entries - fixed size)");
+// Flag for data watchpoints.
+ABSL_FLAG(std::vector<std::string>, data_watchpoints, {},
+          "Comma separated data watchpoints, each address:length[:type], "
+          "where type is r, w (default), rw or c (value change). The "
+          "simulation reports each hit and continues (single hart only)");
 
-// Static pointer to the top instance. Used by the control-C handler.
-static mpact::sim::codelab::RV32ITop *top = nullptr;
+// Static pointers to the top instance. Used by the control-C handler.
+static RV32ITop *top = nullptr;
+static RV32IMultiHartTop *multi_hart_top = nullptr;
+// In batch mode, the top instance run by each worker thread, or nullptr if
+// the worker isn't running a program.
+static std::atomic<std::atomic<RV32ITop *> *> batch_tops = nullptr;
+static int num_batch_tops = 0;
+static std::atomic<bool> batch_interrupted = false;
+// Number of control-c handlers that may be using the batch tops. A batch top
+// (or the array of them) is only destroyed once it has been unpublished and
+// this count has dropped to zero, so that a handler never halts a destroyed
+// top.
+static std::atomic<int> batch_handlers_active = 0;
+
+// Waits until no control-c handler uses the batch tops that were unpublished
+// before the call.
+static void WaitForBatchHandlers() {
+  while (batch_handlers_active.load() != 0) std::this_thread::yield();
+}
 
 // Control-c handler to interrupt any running simulation.
 static void sim_sigint_handler(int arg) {
-  if (top != nullptr) {
+  batch_handlers_active.fetch_add(1);
+  auto *tops = batch_tops.load();
+  if (tops != nullptr) {
+    // Stop the running programs, and don't start any new ones.
+    batch_interrupted.store(true);
+    for (int i = 0; i < num_batch_tops; i++) {
+      auto *batch_top = tops[i].load();
+      if (batch_top != nullptr) (void)batch_top->Halt();
+    }
+  }
+  batch_handlers_active.fetch_sub(1);
+  if (tops != nullptr) {
+    return;
+  } else if (top != nullptr) {
     (void)top->Halt();
     return;
+  } else if (multi_hart_top != nullptr) {
+    (void)multi_hart_top->Halt();
+    return;
   } else {
     exit(-1);
   }
 }
 
+// Returns the kind of memory a single hart core should own. Mapping the elf
+// file requires a mapped memory.
+static RV32ITop::MemoryKind GetMemoryKind() {
+  if (absl::GetFlag(FLAGS_host_memory) || absl::GetFlag(FLAGS_mmap_elf)) {
+    return RV32ITop::MemoryKind::kMapped;
+  }
+  if (absl::GetFlag(FLAGS_flat_memory)) {
+    return RV32ITop::MemoryKind::kFlatDemand;
+  }
+  return RV32ITop::MemoryKind::kDemandPaged;
+}
+
+// Applies the flags that control execution to the core.
+static void ConfigureCore(RV32ITop *core) {
+  core->set_use_threaded_interpreter(absl::GetFlag(FLAGS_threaded));
+  core->set_counter_publish_interval(
+      absl::GetFlag(FLAGS_counter_publish_interval));
+  core->set_instruction_limit(absl::GetFlag(FLAGS_max_instructions));
+  AdaptiveDecodeCache::Options options;
+  options.num_entries = absl::GetFlag(FLAGS_decode_cache_entries);
+  options.minimum_pc_increment =
+      absl::GetFlag(FLAGS_decode_cache_min_pc_increment);
+  options.max_entries = absl::GetFlag(FLAGS_decode_cache_max_entries);
+  CHECK_OK(core->decode_cache()->Configure(options))
+      << "Invalid decode cache configuration";
+}
+
+static void SetUpSigIntHandler() {
+  struct sigaction sa;
+  sa.sa_flags = 0;
+  sigemptyset(&sa.sa_mask);
+  sigaddset(&sa.sa_mask, SIGINT);
+  sa.sa_handler = &sim_sigint_handler;
+  sigaction(SIGINT, &sa, nullptr);
+}
+
 // Helper function to get the magic semihosting addresses from the loader.
 static bool GetMagicAddresses(mpact::sim::util::ElfProgramLoader *loader,
                               RiscV32HtifSemiHost::SemiHostAddresses *magic) {
@@ -80,32 +236,492 @@ static bool GetMagicAddresses(mpact::sim::util::ElfProgramLoader *loader,
   return true;
 }
 
+// Writes the proto to <output_dir>/<basename>.proto.
+static void WriteProto(const ComponentData &component_proto,
+                       const std::string &file_basename) {
+  std::string proto_file_name;
+  if (FLAGS_output_dir.CurrentValue().empty()) {
+    proto_file_name = "./" + file_basename + ".proto";
+  } else {
+    proto_file_name =
+        FLAGS_output_dir.CurrentValue() + "/" + file_basename + ".proto";
+  }
+  std::fstream proto_file(proto_file_name.c_str(), std::ios_base::out);
+  std::string serialized;
+  if (!proto_file.good() ||
+      !google::protobuf::TextFormat::PrintToString(component_proto,
+                                                   &serialized)) {
+    LOG(ERROR) << "Failed to write proto to file";
+  } else {
+    proto_file << serialized;
+    proto_file.close();
+  }
+}
+
+// Exports the counters of the component to <output_dir>/<basename>.proto.
+static void WriteCounters(mpact::sim::generic::Component *component,
+                          const std::string &file_basename) {
+  auto component_proto = std::make_unique<ComponentData>();
+  CHECK_OK(component->Export(component_proto.get()))
+      << "Failed to export proto";
+  WriteProto(*component_proto, file_basename);
+}
+
+// Runs the core to completion, alternating between fast forwarding for
+// ff_instructions, without collecting statistics and using the threaded
+// interpreter, and detailed windows of window_instructions. The counters are
+// then extrapolated from the windows to the whole run. Only the detailed
+// windows are traced. The instruction limit of the core, if any, bounds the
+// whole run.
+static absl::Status SampledRun(RV32ITop &rv32i_top, uint64_t ff_instructions,
+                               uint64_t window_instructions) {
+  bool use_threaded_interpreter = rv32i_top.use_threaded_interpreter();
+  uint64_t instruction_limit = rv32i_top.instruction_limit();
+  uint64_t end = rv32i_top.num_instructions() + instruction_limit;
+  bool fast_forward = true;
+  absl::Status status;
+  while (true) {
+    uint64_t limit = fast_forward ? ff_instructions : window_instructions;
+    if (instruction_limit != 0) {
+      limit = std::min(limit, end - rv32i_top.num_instructions());
+    }
+    rv32i_top.set_collect_statistics(!fast_forward);
+    rv32i_top.set_trace_paused(fast_forward);
+    rv32i_top.set_use_threaded_interpreter(fast_forward ||
+                                           use_threaded_interpreter);
+    rv32i_top.set_instruction_limit(limit);
+    status = rv32i_top.RunToHalt();
+    if (!status.ok()) break;
+    auto halt_reason = rv32i_top.GetLastHaltReason();
+    if (!halt_reason.ok()) {
+      status = halt_reason.status();
+      break;
+    }
+    if (halt_reason.value() != *RV32ITop::kInstructionLimitHaltReason) break;
+    if ((instruction_limit != 0) && (rv32i_top.num_instructions() >= end)) {
+      break;
+    }
+    fast_forward = !fast_forward;
+  }
+  rv32i_top.set_collect_statistics(true);
+  rv32i_top.set_trace_paused(false);
+  rv32i_top.set_use_threaded_interpreter(use_threaded_interpreter);
+  rv32i_top.set_instruction_limit(instruction_limit);
+  rv32i_top.ExtrapolateCounters();
+  return status;
+}
+
+// Returns a trace writer for the trace file, or nullptr if none is specified.
+static TraceWriter *CreateTraceWriter() {
+  std::string trace_file_name = absl::GetFlag(FLAGS_trace_file);
+  if (trace_file_name.empty()) return nullptr;
+  auto result = TraceWriter::Create(trace_file_name);
+  if (!result.ok()) {
+    std::cerr << result.status().message() << std::endl;
+    exit(-1);
+  }
+  return result.value();
+}
+
+// Closes and deletes the trace writer.
+static void CloseTrace(TraceWriter *trace_writer) {
+  if (trace_writer == nullptr) return;
+  auto status = trace_writer->Close();
+  if (!status.ok()) {
+    std::cerr << status.message() << std::endl;
+  }
+  delete trace_writer;
+}
+
+// If enabled, decodes the executable segments of the loaded program.
+static absl::Status PredecodeProgram(
+    RV32ITop &rv32i_top, const mpact::sim::util::ElfProgramLoader &elf_loader,
+    int num_threads) {
+  if (!absl::GetFlag(FLAGS_predecode)) return absl::OkStatus();
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  for (const auto &segment : elf_loader.elf_reader()->segments) {
+    if ((segment->get_type() != PT_LOAD) ||
+        ((segment->get_flags() & PF_X) == 0)) {
+      continue;
+    }
+    uint64_t start = segment->get_virtual_address();
+    ranges.emplace_back(start, start + segment->get_memory_size());
+  }
+  return rv32i_top.Predecode(ranges, num_threads);
+}
+
+// Sets the data watchpoints given by --data_watchpoints.
+static absl::Status SetDataWatchpoints(RV32ITop &rv32i_top) {
+  for (const auto &spec : absl::GetFlag(FLAGS_data_watchpoints)) {
+    std::vector<std::string> fields = absl::StrSplit(spec, ':');
+    uint64_t address;
+    uint64_t length;
+    if ((fields.size() < 2) || (fields.size() > 3) ||
+        !absl::SimpleHexAtoi(fields[0], &address) ||
+        !absl::SimpleAtoi(fields[1], &length)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid data watchpoint '", spec, "'"));
+    }
+    auto type = RV32ITop::WatchType::kWrite;
+    if (fields.size() == 3) {
+      if (fields[2] == "r") {
+        type = RV32ITop::WatchType::kRead;
+      } else if (fields[2] == "w") {
+        type = RV32ITop::WatchType::kWrite;
+      } else if (fields[2] == "rw") {
+        type = RV32ITop::WatchType::kAccess;
+      } else if (fields[2] == "c") {
+        type = RV32ITop::WatchType::kChange;
+      } else {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Invalid data watchpoint type in '", spec, "'"));
+      }
+    }
+    auto status = rv32i_top.SetDataWatchpoint(address, length, type);
+    if (!status.ok()) return status;
+  }
+  return absl::OkStatus();
+}
+
+// Runs the core until it halts for a reason other than a data watchpoint.
+// Each watchpoint hit is reported, and the run continues.
+static absl::Status RunReportingWatchpoints(RV32ITop &rv32i_top) {
+  while (true) {
+    auto status = rv32i_top.Run();
+    if (!status.ok()) return status;
+    status = rv32i_top.Wait();
+    if (!status.ok()) return status;
+    auto halt_reason = rv32i_top.GetLastHaltReason();
+    if (!halt_reason.ok()) return halt_reason.status();
+    if (halt_reason.value() != *RV32ITop::HaltReason::kDataWatchPoint) break;
+    std::string message = absl::StrCat(
+        "Data watchpoint hit at 0x",
+        absl::Hex(rv32i_top.last_watchpoint_address()));
+    auto pc = rv32i_top.ReadRegister("pc");
+    if (pc.ok()) {
+      absl::StrAppend(&message, " (pc 0x", absl::Hex(pc.value()), ")");
+    }
+    std::cerr << message << std::endl;
+  }
+  return absl::OkStatus();
+}
+
+// Loads the program into the core's memory, and returns the entry point. With
+// --mmap_elf the segments are mapped from the file, so a page of the program is
+// only read when it is accessed, and only copied when it is written.
+static absl::StatusOr<uint64_t> LoadProgram(
+    RV32ITop &rv32i_top, mpact::sim::util::ElfProgramLoader &elf_loader,
+    const std::string &full_file_name) {
+  if (!absl::GetFlag(FLAGS_mmap_elf)) {
+    return elf_loader.LoadProgram(full_file_name);
+  }
+  auto entry_point = elf_loader.LoadSymbols(full_file_name);
+  if (!entry_point.ok()) return entry_point.status();
+  for (const auto &segment : elf_loader.elf_reader()->segments) {
+    if ((segment->get_type() != PT_LOAD) ||
+        (segment->get_memory_size() == 0)) {
+      continue;
+    }
+    auto status = rv32i_top.MapFile(
+        segment->get_virtual_address(), full_file_name, segment->get_offset(),
+        segment->get_file_size(), segment->get_memory_size());
+    if (!status.ok()) return status;
+  }
+  return entry_point;
+}
+
+// Returns the file name without directory and extensions.
+static std::string GetBasename(const std::string &full_file_name) {
+  std::string file_name =
+      full_file_name.substr(full_file_name.find_last_of('/') + 1);
+  return file_name.substr(0, file_name.find_first_of('.'));
+}
+
+// Loads the program into the core and runs it to completion. While it runs,
+// the core is published in batch_top so that it can be interrupted. The core
+// is unpublished before returning, and no control-c handler uses it after.
+static absl::Status LoadAndRun(RV32ITop &rv32i_top,
+                               const std::string &full_file_name,
+                               std::atomic<RV32ITop *> &batch_top) {
+  mpact::sim::util::ElfProgramLoader elf_loader(rv32i_top.memory());
+  auto load_result = LoadProgram(rv32i_top, elf_loader, full_file_name);
+  if (!load_result.ok()) return load_result.status();
+  auto status = rv32i_top.WriteRegister("pc", load_result.value());
+  if (!status.ok()) return status;
+  RiscV32HtifSemiHost::SemiHostAddresses magic_addresses;
+  if (GetMagicAddresses(&elf_loader, &magic_addresses)) {
+    status = rv32i_top.SetUpSemiHosting(magic_addresses);
+    if (!status.ok()) return status;
+  }
+  // The programs already run in parallel, so predecode on this thread only.
+  status = PredecodeProgram(rv32i_top, elf_loader, 1);
+  if (!status.ok()) return status;
+  batch_top.store(&rv32i_top);
+  status = rv32i_top.Run();
+  // An interrupt may have arrived before the core started running.
+  if (status.ok() && batch_interrupted.load()) status = rv32i_top.Halt();
+  if (status.ok()) status = rv32i_top.Wait();
+  batch_top.store(nullptr);
+  WaitForBatchHandlers();
+  return status;
+}
+
+// Simulates a single program in batch mode, and returns its counters. Besides
+// the core's counters, the result contains the status of loading and running
+// the program (as an absl::StatusCode), and the reason the core halted.
+static ComponentData SimulateProgram(const std::string &full_file_name,
+                                     std::atomic<RV32ITop *> &batch_top) {
+  // The counters are registered with the top, so they must outlive it.
+  mpact::sim::generic::SimpleCounter<uint64_t> status_counter("status", 0);
+  mpact::sim::generic::SimpleCounter<uint64_t> halt_reason_counter(
+      "halt_reason", 0);
+  RV32ITop rv32i_top(GetBasename(full_file_name), GetMemoryKind());
+  ConfigureCore(&rv32i_top);
+  CHECK_OK(rv32i_top.AddCounter(&status_counter));
+  CHECK_OK(rv32i_top.AddCounter(&halt_reason_counter));
+
+  auto status = LoadAndRun(rv32i_top, full_file_name, batch_top);
+  if (!status.ok()) {
+    std::cerr << full_file_name << ": " << status.message() << std::endl;
+  }
+  status_counter.SetValue(static_cast<uint64_t>(status.code()));
+  auto halt_reason = rv32i_top.GetLastHaltReason();
+  if (halt_reason.ok()) halt_reason_counter.SetValue(halt_reason.value());
+
+  ComponentData component_proto;
+  CHECK_OK(rv32i_top.Export(&component_proto)) << "Failed to export proto";
+  return component_proto;
+}
+
+// Simulates each program listed in the manifest file, each in its own top
+// instance, using a pool of worker threads. The counters of all the programs
+// are written to a single proto file named after the manifest.
+static int RunBatch(const std::string &manifest_file_name) {
+  std::ifstream manifest(manifest_file_name);
+  if (!manifest.good()) {
+    std::cerr << "Unable to open manifest '" << manifest_file_name << "'\n";
+    return -1;
+  }
+  // One elf file per line. Empty lines and lines starting with '#' are
+  // ignored.
+  std::vector<std::string> elf_files;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    std::string elf_file(absl::StripAsciiWhitespace(line));
+    if (elf_file.empty() || (elf_file[0] == '#')) continue;
+    elf_files.push_back(elf_file);
+  }
+  if (elf_files.empty()) return 0;
+
+  // Each program runs to completion on a single hart, with its counters
+  // written to the batch proto.
+  if (!absl::GetFlag(FLAGS_trace_file).empty()) {
+    std::cerr << "--trace_file is ignored in batch mode\n";
+  }
+  if ((absl::GetFlag(FLAGS_ff_instructions) > 0) ||
+      (absl::GetFlag(FLAGS_interval_instructions) > 0)) {
+    std::cerr << "--ff_instructions and --interval_instructions are ignored "
+                 "in batch mode\n";
+  }
+  if (!absl::GetFlag(FLAGS_restore_checkpoint).empty() ||
+      !absl::GetFlag(FLAGS_save_checkpoint).empty()) {
+    std::cerr << "--restore_checkpoint and --save_checkpoint are ignored in "
+                 "batch mode\n";
+  }
+  if (!absl::GetFlag(FLAGS_data_watchpoints).empty()) {
+    std::cerr << "--data_watchpoints is ignored in batch mode\n";
+  }
+  if (absl::GetFlag(FLAGS_harts) > 1) {
+    std::cerr << "--harts is ignored in batch mode\n";
+  }
+  if (absl::GetFlag(FLAGS_i) || absl::GetFlag(FLAGS_interactive)) {
+    std::cerr << "Interactive mode is ignored in batch mode\n";
+  }
+
+  int num_threads = absl::GetFlag(FLAGS_batch_threads);
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min<int>(num_threads, elf_files.size());
+
+  // Set up control-c handling.
+  auto tops = std::make_unique<std::atomic<RV32ITop *>[]>(num_threads);
+  num_batch_tops = num_threads;
+  batch_tops.store(tops.get());
+  SetUpSigIntHandler();
+
+  std::cerr << "Starting simulation of " << elf_files.size()
+            << " programs on " << num_threads << " threads\n";
+  // The programs are handed out from a shared index, so a worker that is done
+  // with its program picks up the next one, and the load is balanced no
+  // matter how long each program runs.
+  std::vector<ComponentData> results(elf_files.size());
+  std::atomic<size_t> next_program = 0;
+  std::vector<std::thread> workers;
+  for (int w = 0; w < num_threads; w++) {
+    workers.emplace_back([&, w]() {
+      for (size_t i = next_program.fetch_add(1); i < elf_files.size();
+           i = next_program.fetch_add(1)) {
+        if (batch_interrupted.load()) break;
+        results[i] = SimulateProgram(elf_files[i], tops[w]);
+      }
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  batch_tops.store(nullptr);
+  WaitForBatchHandlers();
+  std::cerr << "Simulation done\n";
+
+  // Aggregate the results in manifest order. Programs that weren't run due to
+  // an interrupt have no name, and are left out.
+  ComponentData batch_proto;
+  batch_proto.set_name("batch");
+  for (auto &result : results) {
+    if (result.name().empty()) continue;
+    *batch_proto.add_component_data() = std::move(result);
+  }
+  WriteProto(batch_proto, GetBasename(manifest_file_name));
+  return 0;
+}
+
+// Simulates the program on a number of harts that share the memory.
+static int RunMultiHart(const std::string &full_file_name,
+                        const std::string &file_basename, int num_harts) {
+  RV32IMultiHartTop rv32i_top("RV32I", num_harts);
+  rv32i_top.set_quantum(absl::GetFlag(FLAGS_hart_quantum));
+  for (int i = 0; i < num_harts; i++) ConfigureCore(rv32i_top.hart(i));
+  // The instruction limit is used to implement the quanta, so it can't be
+  // applied per hart.
+  if (absl::GetFlag(FLAGS_max_instructions) != 0) {
+    std::cerr << "--max_instructions is ignored with multiple harts\n";
+  }
+  // The harts share a memory of their own (see other/shared_memory.h).
+  if (absl::GetFlag(FLAGS_host_memory) || absl::GetFlag(FLAGS_flat_memory) ||
+      absl::GetFlag(FLAGS_mmap_elf)) {
+    std::cerr << "--host_memory, --flat_memory and --mmap_elf are ignored "
+                 "with multiple harts\n";
+  }
+  if (!absl::GetFlag(FLAGS_data_watchpoints).empty()) {
+    std::cerr << "--data_watchpoints is ignored with multiple harts\n";
+  }
+
+  // Set up control-c handling.
+  multi_hart_top = &rv32i_top;
+  SetUpSigIntHandler();
+
+  // Load the elf segments into the shared memory.
+  mpact::sim::util::ElfProgramLoader elf_loader(rv32i_top.memory());
+  auto load_result = elf_loader.LoadProgram(full_file_name);
+  if (!load_result.ok()) {
+    std::cerr << "Error while loading '" << full_file_name
+              << "': " << load_result.status().message();
+    return -1;
+  }
+
+  // All harts start at the entry point.
+  auto pc_write = rv32i_top.SetPc(load_result.value());
+  if (!pc_write.ok()) {
+    std::cerr << "Error writing to pc: " << pc_write.message();
+  }
+
+  // Set up semihosting.
+  RiscV32HtifSemiHost::SemiHostAddresses magic_addresses;
+  if (GetMagicAddresses(&elf_loader, &magic_addresses)) {
+    auto status = rv32i_top.SetUpSemiHosting(magic_addresses);
+    if (!status.ok()) {
+      std::cerr << "Failed to set up semihosting\n";
+      exit(-1);
+    }
+  }
+
+  // Each hart has its own decode cache.
+  for (int i = 0; i < num_harts; i++) {
+    auto status = PredecodeProgram(*rv32i_top.hart(i), elf_loader,
+                                   absl::GetFlag(FLAGS_predecode_threads));
+    if (!status.ok()) {
+      std::cerr << "Failed to predecode: " << status.message() << std::endl;
+    }
+  }
+
+  // Each hart is traced in its own stream.
+  TraceWriter *trace_writer = CreateTraceWriter();
+  if (trace_writer != nullptr) {
+    for (int i = 0; i < num_harts; i++) {
+      CHECK_OK(rv32i_top.hart(i)->StartTracing(trace_writer));
+    }
+  }
+
+  bool interactive = absl::GetFlag(FLAGS_i) || absl::GetFlag(FLAGS_interactive);
+  if (interactive) {
+    // Each hart is a separate core in the debug shell.
+    mpact::sim::riscv::DebugCommandShell cmd_shell;
+    for (int i = 0; i < num_harts; i++) {
+      cmd_shell.AddCore({rv32i_top.debug_interface(i),
+                         [&elf_loader]() { return &elf_loader; }});
+    }
+    cmd_shell.Run(std::cin, std::cout);
+  } else {
+    std::cerr << "Starting simulation\n";
+
+    auto run_status = rv32i_top.Run();
+    if (!run_status.ok()) {
+      std::cerr << run_status.message() << std::endl;
+    }
+
+    auto wait_status = rv32i_top.Wait();
+    if (!wait_status.ok()) {
+      std::cerr << wait_status.message() << std::endl;
+    }
+
+    std::cerr << "Simulation done\n";
+  }
+  multi_hart_top = nullptr;
+
+  if (trace_writer != nullptr) {
+    for (int i = 0; i < num_harts; i++) {
+      (void)rv32i_top.hart(i)->StopTracing();
+    }
+    CloseTrace(trace_writer);
+  }
+
+  WriteCounters(&rv32i_top, file_basename);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   auto arg_vec = absl::ParseCommandLine(argc, argv);
 
+  std::string manifest_file_name = absl::GetFlag(FLAGS_batch_manifest);
+  if (!manifest_file_name.empty()) {
+    if (arg_vec.size() > 1) {
+      std::cerr << "No input file allowed in batch mode" << std::endl;
+      return -1;
+    }
+    return RunBatch(manifest_file_name);
+  }
+
   if (arg_vec.size() > 2) {
     std::cerr << "Only a single input file allowed" << std::endl;
     return -1;
   }
   std::string full_file_name = arg_vec[1];
-  std::string file_name =
-      full_file_name.substr(full_file_name.find_last_of('/') + 1);
-  std::string file_basename = file_name.substr(0, file_name.find_first_of('.'));
+  std::string file_basename = GetBasename(full_file_name);
+
+  int num_harts = absl::GetFlag(FLAGS_harts);
+  if (num_harts > 1) {
+    return RunMultiHart(full_file_name, file_basename, num_harts);
+  }
 
-  mpact::sim::codelab::RV32ITop rv32i_top("RV32I");
+  RV32ITop rv32i_top("RV32I", GetMemoryKind());
+  ConfigureCore(&rv32i_top);
 
   // Set up control-c handling.
   top = &rv32i_top;
-  struct sigaction sa;
-  sa.sa_flags = 0;
-  sigemptyset(&sa.sa_mask);
-  sigaddset(&sa.sa_mask, SIGINT);
-  sa.sa_handler = &sim_sigint_handler;
-  sigaction(SIGINT, &sa, nullptr);
+  SetUpSigIntHandler();
 
   // Load the elf segments into memory.
   mpact::sim::util::ElfProgramLoader elf_loader(rv32i_top.memory());
-  auto load_result = elf_loader.LoadProgram(full_file_name);
+  auto load_result = LoadProgram(rv32i_top, elf_loader, full_file_name);
   if (!load_result.ok()) {
     std::cerr << "Error while loading '" << full_file_name
               << "': " << load_result.status().message();
@@ -128,46 +744,108 @@ int main(int argc, char **argv) {
     }
   }
 
-  // Determine if this is being run interactively or as a batch job.
+  // Restore the checkpoint, if any. This replaces the program state that was
+  // set up above, but the elf file is still needed for its symbols.
+  std::string restore_file_name = absl::GetFlag(FLAGS_restore_checkpoint);
+  if (!restore_file_name.empty()) {
+    std::ifstream checkpoint(restore_file_name, std::ios_base::binary);
+    auto status = rv32i_top.RestoreCheckpoint(checkpoint);
+    if (!status.ok()) {
+      std::cerr << "Failed to restore checkpoint '" << restore_file_name
+                << "': " << status.message() << std::endl;
+      exit(-1);
+    }
+  }
+
+  // Restoring a checkpoint invalidates any decoded instructions, so predecode
+  // after it.
+  auto predecode_status = PredecodeProgram(
+      rv32i_top, elf_loader, absl::GetFlag(FLAGS_predecode_threads));
+  if (!predecode_status.ok()) {
+    std::cerr << "Failed to predecode: " << predecode_status.message()
+              << std::endl;
+  }
+
+  // Data watchpoints halt the core, which the sampled and interval runs would
+  // mistake for the end of the program.
+  bool has_watchpoints = !absl::GetFlag(FLAGS_data_watchpoints).empty();
+  if (has_watchpoints && ((absl::GetFlag(FLAGS_ff_instructions) > 0) ||
+                          (absl::GetFlag(FLAGS_interval_instructions) > 0))) {
+    std::cerr << "--data_watchpoints can't be combined with --ff_instructions "
+                 "or --interval_instructions\n";
+    exit(-1);
+  }
+  auto watchpoint_status = SetDataWatchpoints(rv32i_top);
+  if (!watchpoint_status.ok()) {
+    std::cerr << "Failed to set data watchpoints: "
+              << watchpoint_status.message() << std::endl;
+    exit(-1);
+  }
+
+  TraceWriter *trace_writer = CreateTraceWriter();
+  if (trace_writer != nullptr) CHECK_OK(rv32i_top.StartTracing(trace_writer));
+
+  // Determine if this is being run interactively or as a batch job. In
+  // interval mode, the counters are merged in the interval driver.
+  std::unique_ptr<IntervalDriver> interval_driver;
   bool interactive = absl::GetFlag(FLAGS_i) || absl::GetFlag(FLAGS_interactive);
   if (interactive) {
     mpact::sim::riscv::DebugCommandShell cmd_shell;
     cmd_shell.AddCore({&rv32i_top, [&elf_loader]() { return &elf_loader;}});
     cmd_shell.Run(std::cin, std::cout);
+  } else if (absl::GetFlag(FLAGS_ff_instructions) > 0) {
+    std::cerr << "Starting sampled simulation\n";
+
+    auto status = SampledRun(rv32i_top, absl::GetFlag(FLAGS_ff_instructions),
+                             absl::GetFlag(FLAGS_window_instructions));
+    if (!status.ok()) {
+      std::cerr << status.message() << std::endl;
+    }
+
+    std::cerr << "Simulation done\n";
+  } else if (absl::GetFlag(FLAGS_interval_instructions) > 0) {
+    std::cerr << "Starting interval simulation\n";
+
+    interval_driver = std::make_unique<IntervalDriver>(
+        absl::GetFlag(FLAGS_interval_instructions),
+        absl::GetFlag(FLAGS_interval_threads), &ConfigureCore);
+    auto status = interval_driver->Run(&rv32i_top);
+    if (!status.ok()) {
+      std::cerr << status.message() << std::endl;
+    }
+
+    std::cerr << "Simulation done (" << interval_driver->num_intervals()
+              << " intervals)\n";
   } else {
     std::cerr << "Starting simulation\n";
 
-    auto run_status = rv32i_top.Run();
+    auto run_status = RunReportingWatchpoints(rv32i_top);
     if (!run_status.ok()) {
       std::cerr << run_status.message() << std::endl;
     }
 
-    auto wait_status = rv32i_top.Wait();
-    if (!wait_status.ok()) {
-      std::cerr << wait_status.message() << std::endl;
-    }
-
     std::cerr << "Simulation done\n";
   }
 
-  // Export counters.
-  auto component_proto = std::make_unique<ComponentData>();
-  CHECK_OK(rv32i_top.Export(component_proto.get())) << "Failed to export proto";
-  std::string proto_file_name;
-  if (FLAGS_output_dir.CurrentValue().empty()) {
-    proto_file_name = "./" + file_basename + ".proto";
-  } else {
-    proto_file_name =
-        FLAGS_output_dir.CurrentValue() + "/" + file_basename + ".proto";
+  if (trace_writer != nullptr) {
+    (void)rv32i_top.StopTracing();
+    CloseTrace(trace_writer);
   }
-  std::fstream proto_file(proto_file_name.c_str(), std::ios_base::out);
-  std::string serialized;
-  if (!proto_file.good() || !google::protobuf::TextFormat::PrintToString(
-                                *component_proto.get(), &serialized)) {
-    LOG(ERROR) << "Failed to write proto to file";
-  } else {
-    proto_file << serialized;
-    proto_file.close();
+
+  std::string save_file_name = absl::GetFlag(FLAGS_save_checkpoint);
+  if (!save_file_name.empty()) {
+    std::ofstream checkpoint(save_file_name,
+                             std::ios_base::binary | std::ios_base::trunc);
+    auto status = rv32i_top.SaveCheckpoint(checkpoint);
+    if (!status.ok()) {
+      std::cerr << "Failed to save checkpoint '" << save_file_name
+                << "': " << status.message() << std::endl;
+    }
   }
 
+  if (interval_driver != nullptr) {
+    WriteCounters(interval_driver->merged(), file_basename);
+  } else {
+    WriteCounters(&rv32i_top, file_basename);
+  }
 }
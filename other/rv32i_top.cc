@@ -15,20 +15,29 @@
 #include "other/rv32i_top.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
-#include "absl/functional/bind_front.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "mpact/sim/generic/data_buffer.h"
 #include "mpact/sim/generic/type_helpers.h"
+#include "other/trace_format.h"
+#include "other/trace_writer.h"
 #include "riscv/riscv32_htif_semihost.h"
-#include "riscv/riscv_action_point.h"
-#include "riscv/riscv_breakpoint.h"
+#include "riscv_bin_decoder/solution/riscv32i_bin_decoder.h"
 
 namespace mpact {
 namespace sim {
@@ -45,68 +54,116 @@ constexpr char kRegisterAliases[32][6] = {
     "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
     "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
 
+// Checkpoint file identifier, including the format version.
+constexpr char kCheckpointMagic[8] = {'R', 'V', '3', '2', 'C', 'K', 'P', '1'};
+// Address used to mark the end of the memory pages in a checkpoint. It can't
+// be the address of a page, as it isn't page aligned.
+constexpr uint32_t kCheckpointEndOfPages = 0xffff'ffff;
+
+// Helpers for writing and reading checkpoint data. Values are stored in host
+// byte order.
+template <typename T>
+static void WriteValue(std::ostream &os, T value) {
+  os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static void WriteString(std::ostream &os, const std::string &str) {
+  WriteValue<uint16_t>(os, str.size());
+  os.write(str.data(), str.size());
+}
+
+template <typename T>
+static bool ReadValue(std::istream &is, T &value) {
+  is.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return is.good();
+}
+
+static bool ReadString(std::istream &is, std::string &str) {
+  uint16_t size;
+  if (!ReadValue(is, size)) return false;
+  str.resize(size);
+  is.read(str.data(), size);
+  return is.good();
+}
+
 RV32ITop::RV32ITop(std::string name)
+    : RV32ITop(name, nullptr, MemoryKind::kDemandPaged) {}
+
+RV32ITop::RV32ITop(std::string name, MemoryKind memory_kind)
+    : RV32ITop(name, nullptr, memory_kind) {}
+
+RV32ITop::RV32ITop(std::string name, util::MemoryInterface *memory)
+    : RV32ITop(name, memory, MemoryKind::kFlatDemand) {}
+
+RV32ITop::RV32ITop(std::string name, util::MemoryInterface *memory,
+                   MemoryKind memory_kind)
     : Component(name),
-      counter_num_instructions_("num_instructions", 0) {
-  // Using a single flat memory for this core.
-  memory_ = new util::FlatDemandMemory(0);
+      memory_(memory),
+      counter_num_instructions_("num_instructions", 0),
+      counter_num_fast_forwarded_("num_fast_forwarded_instructions", 0),
+      counter_num_sampled_("num_sampled_instructions", 0) {
+  // Unless a memory is provided, create one of the given kind for this core.
+  if (memory_ == nullptr) {
+    if (memory_kind == MemoryKind::kMapped) {
+      auto result = MappedMemory::Create();
+      CHECK_OK(result.status()) << "Failed to create mapped memory";
+      owned_memory_ = mapped_memory_ = result.value();
+    } else if (memory_kind == MemoryKind::kDemandPaged) {
+      owned_memory_ = paged_memory_ = new DemandPagedMemory();
+    } else {
+      owned_memory_ = new util::FlatDemandMemory(0);
+    }
+    page_tracker_ = new PageTrackingMemory(owned_memory_);
+    memory_ = page_tracker_;
+  }
   // Creat the simulation state.
   state_ = new RiscVState(kRiscV32Name, RiscVXlen::RV32, memory_);
   pc_ = state_->GetRegister<RV32Register>(RiscVState::kPcName).first;
   // Set up the decoder and decode cache.
   rv32_decoder_ = new RiscV32Decoder(state_, memory_);
-  rv32_decode_cache_ =
-      generic::DecodeCache::Create({16 * 1024, 2}, rv32_decoder_);
+  rv32_decode_cache_ = new AdaptiveDecodeCache("decode_cache", rv32_decoder_);
+  AddChildComponent(*rv32_decode_cache_);
+  block_cache_ = new BasicBlockCache(rv32_decode_cache_);
   // Register instruction opcode counters.
   for (int i = 0; i < static_cast<int>(OpcodeEnum::kPastMaxValue); i++) {
     counter_opcode_[i].Initialize(absl::StrCat("num_", kOpcodeNames[i]), 0);
     CHECK_OK(AddCounter(&counter_opcode_[i]));
   }
-  // Register instruction counter.
+  // Register instruction counters.
   CHECK_OK(AddCounter(&counter_num_instructions_))
       << "Failed to register counter";
+  CHECK_OK(AddCounter(&counter_num_fast_forwarded_))
+      << "Failed to register counter";
+  CHECK_OK(AddCounter(&counter_num_sampled_))
+      << "Failed to register counter";
 
-  rv_ap_manager_ = new RiscVActionPointManager(
-      memory_,
-      absl::bind_front(&generic::DecodeCache::Invalidate, rv32_decode_cache_));
-  rv_bp_manager_ = new RiscVBreakpointManager(
-      rv_ap_manager_,
-      [this](HaltReason halt_reason) { RequestHalt(halt_reason, nullptr); });
-  // Set the software breakpoint callback.
-  state_->AddEbreakHandler([this](const Instruction *inst) -> bool {
-    // If there is a breakpoint, handle it and return true to signal that
-    // the ebreak has been handled. Otherwise return false.
-    if ((inst != nullptr) && (HasBreakpoint(inst->address()))) {
-      RequestHalt(HaltReason::kSoftwareBreakpoint, inst);
-      return true;
-    }
-    return false;
-  });
   // Make sure the architectural and abi register aliases are added.
   for (int i = 0; i < 32; i++) {
     std::string reg_name = absl::StrCat(RiscVState::kXregPrefix, i);
-    (void)state_->AddRegister<RV32Register>(reg_name);
     (void)state_->AddRegisterAlias<RV32Register>(reg_name, kRegisterAliases[i]);
   }
+  threaded_interpreter_ = new ThreadedInterpreter(state_, memory_);
+  UpdateHostMemory();
 }
 
 RV32ITop::~RV32ITop() {
   // If the simulator is still running, request a halt (set halted_ to true),
   // and wait until the simulator finishes before continuing the destructor.
-  if (run_status_ == RunStatus::kRunning) {
-    run_halted_->WaitForNotification();
-    delete run_halted_;
-    run_halted_ = nullptr;
-  }
+  (void)Halt();
+  (void)Wait();
 
   delete rv32_semihost_;
-  delete rv_bp_manager_;
-  delete rv_ap_manager_;
+  delete semihost_recorder_;
+  delete semihost_requests_;
+  delete threaded_interpreter_;
+  delete block_cache_;
   delete rv32_decode_cache_;
   delete rv32_decoder_;
   delete state_;
+  delete watchpoint_memory_;
   delete watcher_;
-  delete memory_;
+  delete page_tracker_;
+  delete owned_memory_;
 }
 
 absl::Status RV32ITop::Halt() {
@@ -118,8 +175,7 @@ absl::Status RV32ITop::Halt() {
   if (run_status_ != RunStatus::kRunning) {
     return absl::FailedPreconditionError("RV32ITop::Halt: Core is not running");
   }
-  halt_reason_ = HaltReason::kUserRequest;
-  halted_ = true;
+  RequestHalt(HaltReason::kUserRequest, nullptr);
   return absl::OkStatus();
 }
 
@@ -132,136 +188,271 @@ absl::StatusOr<int> RV32ITop::Step(int num) {
     return absl::FailedPreconditionError("RV32ITop::Step: Core must be halted");
   }
   run_status_ = RunStatus::kSingleStep;
-  int count = 0;
-  halted_ = false;
-
-  // First check to see if the previous halt was due to a breakpoint. If so,
-  // need to step over the breakpoint.
-  if (halt_reason_ == HaltReason::kSoftwareBreakpoint) {
-    auto bp_pc = previous_pc_;
-    // Disable the breakpoint. Status will show error if there is no breakpoint.
-    auto status = rv_bp_manager_->DisableBreakpoint(bp_pc);
-    // Execute the real instruction.
-    auto prev_inst = rv32_decode_cache_->GetDecodedInstruction(bp_pc);
-    prev_inst->Execute(nullptr);
-    counter_opcode_[prev_inst->opcode()].Increment(1);
-    counter_num_instructions_.Increment(1);
-    count++;
-    // Re-enable the breakpoint.
-    if (status.ok()) {
-      status = rv_bp_manager_->EnableBreakpoint(bp_pc);
-      if (!status.ok()) return status;
-    }
-    // No longer stopped at breakpoint, so update halt reason.
-    halt_reason_ = HaltReason::kNone;
-  }
+  halted_.store(false, std::memory_order_relaxed);
+  // If the previous halt was due to a breakpoint, need to step over it.
+  step_over_breakpoint_ = halt_reason_ == HaltReason::kSoftwareBreakpoint;
+  halt_reason_ = HaltReason::kNone;
 
   // Step the simulator forward until the number of steps have been achieved, or
-  // there is a halt request.
-
-  DataBuffer *pc_db = pc_->data_buffer();
-  uint32_t next_pc = pc_db->Get<uint32_t>(0);
-  uint32_t pc;
-  while (count < num) {
-    pc = next_pc;
-    auto *inst = rv32_decode_cache_->GetDecodedInstruction(pc);
-    inst->Execute(nullptr);
-    count++;
-    next_pc += inst->size();
-    DataBuffer *tmp_db = pc_->data_buffer();
-    if (pc_db != tmp_db) {
-      // PC has been updated by an instruction.
-      pc_db = tmp_db;
-      next_pc = pc_db->Get<uint32_t>(0);
-    }
-    counter_opcode_[inst->opcode()].Increment(1);
-    counter_num_instructions_.Increment(1);
-    if (halted_) break;
-  }
-  previous_pc_ = pc;
-  // Update the pc register, now that it can be read.
-  pc_db->Set<uint32_t>(0, next_pc);
-  // If there is no halt request, there is no specific halt reason.
-  if (!halted_) {
-    halt_reason_ = HaltReason::kNone;
-  }
+  // there is a halt request. This uses the same execution core as Run(), so
+  // large step counts execute at full speed.
+  int count = Execute(pc_->data_buffer()->Get<uint32_t>(0), num);
+  PublishCounters();
   run_status_ = RunStatus::kHalted;
   return count;
 }
 
 absl::Status RV32ITop::Run() {
+  auto status = PrepareRun();
+  if (!status.ok()) return status;
+
+  // The simulator is now run in a separate thread so as to allow a user
+  // interface to continue operating. Allocate a new run_halted_ Notification
+  // object, as they are single use only.
+  run_halted_ = new absl::Notification();
+
+  // The thread is detached so it executes without having to be joined.
+  std::thread([this]() {
+    RunLoop();
+    // Notify that the run has completed.
+    run_halted_->Notify();
+  }).detach();
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::RunToHalt() {
+  auto status = PrepareRun();
+  if (!status.ok()) return status;
+  RunLoop();
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::PrepareRun() {
   // Verify that the core isn't running already.
   if (run_status_ == RunStatus::kRunning) {
     return absl::FailedPreconditionError(
         "RV32ITop::Run: core is already running");
   }
+  // If the previous halt was due to a breakpoint, need to step over it.
+  step_over_breakpoint_ = halt_reason_ == HaltReason::kSoftwareBreakpoint;
+  halt_reason_ = HaltReason::kNone;
+  run_status_ = RunStatus::kRunning;
+  halted_.store(false, std::memory_order_relaxed);
+  return absl::OkStatus();
+}
 
-  // First check to see if the previous halt was due to a breakpoint. If so,
-  // need to step over the breakpoint.
-  if (halt_reason_ == HaltReason::kSoftwareBreakpoint) {
-    auto bp_pc = previous_pc_;
-    // Disable the breakpoint.
-    auto status = rv_bp_manager_->DisableBreakpoint(bp_pc);
-    // Execute the real instruction.
-    auto prev_inst = rv32_decode_cache_->GetDecodedInstruction(bp_pc);
-    prev_inst->Execute(nullptr);
-    counter_opcode_[prev_inst->opcode()].Increment(1);
-    counter_num_instructions_.Increment(1);
-    // Re-enable the breakpoint.
-    if (status.ok()) {
-      status = rv_bp_manager_->EnableBreakpoint(bp_pc);
-      if (!status.ok()) return status;
-    }
-    // No longer stopped at breakpoint, so update halt reason.
-    halt_reason_ = HaltReason::kNone;
+void RV32ITop::RunLoop() {
+  uint64_t max_count =
+      instruction_limit_ == 0 ? kUnbounded : instruction_limit_;
+  uint64_t count = Execute(pc_->data_buffer()->Get<uint32_t>(0), max_count);
+  if ((count == max_count) && !halted_.load(std::memory_order_relaxed)) {
+    RequestHalt(kInstructionLimitHaltReason, nullptr);
   }
+  PublishCounters();
+  run_status_.store(RunStatus::kHalted, std::memory_order_release);
+}
 
-  run_status_ = RunStatus::kRunning;
-  halted_ = false;
-
-  // The simulator is now run in a separate thread so as to allow a user
-  // interface to continue operating. Allocate a new run_halted_ Notification
-  // object, as they are single use only.
-  run_halted_ = new absl::Notification();
+uint64_t RV32ITop::Execute(uint32_t start_pc, uint64_t max_count) {
+  // Select the specialization of the execution core, so that the checks that
+  // aren't needed are compiled out of the inner loop.
+  bool traced = (trace_stream_ != nullptr) && !trace_paused_;
+  if (max_count == kUnbounded) {
+    return traced ? ExecuteBlocks<false, true>(start_pc, max_count)
+                  : ExecuteBlocks<false, false>(start_pc, max_count);
+  }
+  return traced ? ExecuteBlocks<true, true>(start_pc, max_count)
+                : ExecuteBlocks<true, false>(start_pc, max_count);
+}
 
-  // The thread is detached so it executes without having to be joined.
-  std::thread([this]() {
-    DataBuffer *pc_db = pc_->data_buffer();
-    uint32_t next_pc = pc_db->Get<uint32_t>(0);
-    uint32_t pc;
-    while (!halted_) {
+template <bool kBounded, bool kInstrumented>
+uint64_t RV32ITop::ExecuteBlocks(uint32_t start_pc, uint64_t max_count) {
+  if (kBounded && (max_count == 0)) return 0;
+  DataBuffer *pc_db = pc_->data_buffer();
+  uint32_t next_pc = start_pc;
+  uint32_t pc;
+  uint64_t total = 0;
+  // A breakpoint at the start pc is skipped if the core is resuming from it.
+  bool check_breakpoint = !step_over_breakpoint_;
+  step_over_breakpoint_ = false;
+  auto *block = block_cache_->GetBlock(next_pc);
+  while (true) {
+    // Breakpoints are always at the start of a block, and halt the core
+    // before the block executes.
+    if (block->is_breakpoint && check_breakpoint) {
+      RequestHalt(HaltReason::kSoftwareBreakpoint, nullptr);
       pc = next_pc;
-      auto *inst = rv32_decode_cache_->GetDecodedInstruction(pc);
-      inst->Execute(nullptr);
-      next_pc += inst->size();
+      break;
+    }
+    check_breakpoint = true;
+    int count = 0;
+    if constexpr (kInstrumented) {
+      // Tracing handles the instruction limit itself.
+      count = ExecuteTraced(block, max_count - total);
+      auto *inst = block->instructions[count - 1];
+      pc = inst->address();
+      next_pc = pc + inst->size();
+      DataBuffer *tmp_db = pc_->data_buffer();
+      if (pc_db != tmp_db) {
+        // PC has been updated by an instruction.
+        pc_db = tmp_db;
+        next_pc = pc_db->Get<uint32_t>(0);
+      }
+    } else if (kBounded && (block->instructions.size() > max_count - total)) {
+      // Only part of the block can be executed before reaching the
+      // instruction limit. None of these instructions change the pc.
+      Instruction *inst = nullptr;
+      while (static_cast<uint64_t>(count) < max_count - total) {
+        inst = block->instructions[count++];
+        inst->Execute(nullptr);
+        if (halted_.load(std::memory_order_relaxed)) break;
+      }
+      pc = inst->address();
+      next_pc = pc + inst->size();
+    } else if (use_threaded_interpreter_) {
+      count = threaded_interpreter_->ExecuteBlock(block, halted_, next_pc);
+      pc = block->instructions[count - 1]->address();
+      pc_db = pc_->data_buffer();
+    } else {
+      // Execute the block. Only the last instruction in a block can change
+      // the pc, so there is no need to track the pc within the block.
+      // Asynchronous halt requests are polled once per block, but the
+      // instructions that may request a halt themselves are followed by a
+      // check, so that the core stops right after them.
+      Instruction *inst = nullptr;
+      uint64_t halt_check_mask = block->halt_check_mask;
+      for (auto *block_inst : block->instructions) {
+        inst = block_inst;
+        inst->Execute(nullptr);
+        count++;
+        if ((halt_check_mask & 1) &&
+            halted_.load(std::memory_order_relaxed)) {
+          break;
+        }
+        halt_check_mask >>= 1;
+      }
+      pc = inst->address();
+      next_pc = pc + inst->size();
       DataBuffer *tmp_db = pc_->data_buffer();
       if (pc_db != tmp_db) {
         // PC has been updated by an instruction.
         pc_db = tmp_db;
         next_pc = pc_db->Get<uint32_t>(0);
       }
-      counter_opcode_[inst->opcode()].Increment(1);
-      counter_num_instructions_.Increment(1);
     }
-    previous_pc_ = pc;
-    // Update the pc register, now that it can be read.
-    pc_db->Set<uint32_t>(0, next_pc);
-    run_status_ = RunStatus::kHalted;
-    // Notify that the run has completed.
-    run_halted_->Notify();
-  }).detach();
-  return absl::OkStatus();
+    if (collect_statistics_) {
+      for (int i = 0; i < count; i++) {
+        opcode_counts_[block->instructions[i]->opcode()]++;
+      }
+    } else {
+      num_fast_forwarded_ += count;
+    }
+    num_unpublished_ += count;
+    total += count;
+    // Poll for halt requests.
+    if (halted_.load(std::memory_order_acquire)) break;
+    if (kBounded && (total == max_count)) break;
+    if ((counter_publish_interval_ != 0) &&
+        (num_unpublished_ >= counter_publish_interval_)) {
+      PublishCounters();
+    }
+    block = block_cache_->GetSuccessor(block, next_pc);
+  }
+  previous_pc_ = pc;
+  // Update the pc register, now that it can be read.
+  pc_db->Set<uint32_t>(0, next_pc);
+  return total;
 }
 
-absl::Status RV32ITop::Wait() {
-  // If the simulator isn't running, then just return.
-  if (run_status_ != RunStatus::kRunning) {
-    delete run_halted_;
-    run_halted_ = nullptr;
-    return absl::OkStatus();
+int RV32ITop::ExecuteTraced(BasicBlock *block, uint64_t max_count) {
+  if (block->trace_info.empty()) LowerTraceInfo(block);
+  int size = std::min<uint64_t>(block->instructions.size(), max_count);
+  uint64_t halt_check_mask = block->halt_check_mask;
+  TraceRecord record;
+  int count = 0;
+  while (count < size) {
+    auto *inst = block->instructions[count];
+    auto &info = block->trace_info[count];
+    count++;
+    record.flags = 0;
+    record.pc = inst->address();
+    if (info.word_epoch != trace_epoch_) {
+      info.word_epoch = trace_epoch_;
+      record.flags |= kTraceWord;
+      record.word = info.word;
+    }
+    // The address has to be computed before the instruction executes, as a
+    // load may overwrite its base register.
+    if (info.is_memory_access) {
+      record.flags |= kTraceMemAddress;
+      record.mem_address = ReadXreg(info.rs1) + info.offset;
+    }
+    inst->Execute(nullptr);
+    if (info.rd != 0) {
+      record.flags |= kTraceRegWrite;
+      record.rd = info.rd;
+      record.rd_value = ReadXreg(info.rd);
+    }
+    trace_stream_->Append(record);
+    if ((halt_check_mask & 1) && halted_.load(std::memory_order_relaxed)) {
+      break;
+    }
+    halt_check_mask >>= 1;
   }
+  return count;
+}
 
-  // Wait for the simulator to finish - i.e., notification on run_halted_
+void RV32ITop::LowerTraceInfo(BasicBlock *block) {
+  auto *db = db_factory_.Allocate<uint32_t>(1);
+  block->trace_info.resize(block->instructions.size());
+  for (size_t i = 0; i < block->instructions.size(); i++) {
+    auto *inst = block->instructions[i];
+    auto &info = block->trace_info[i];
+    // Read the instruction word bypassing any semihosting.
+    memory_->Load(inst->address(), db, nullptr, nullptr);
+    info.word = db->Get<uint32_t>(0);
+    switch (static_cast<OpcodeEnum>(inst->opcode())) {
+      case OpcodeEnum::kLb:
+      case OpcodeEnum::kLbu:
+      case OpcodeEnum::kLh:
+      case OpcodeEnum::kLhu:
+      case OpcodeEnum::kLw:
+        info.rd = inst32_format::ExtractRd(info.word);
+        info.is_memory_access = true;
+        info.rs1 = inst32_format::ExtractRs1(info.word);
+        info.offset = inst32_format::ExtractImm12(info.word);
+        break;
+      case OpcodeEnum::kSb:
+      case OpcodeEnum::kSh:
+      case OpcodeEnum::kSw:
+        info.is_memory_access = true;
+        info.rs1 = inst32_format::ExtractRs1(info.word);
+        info.offset = inst32_format::ExtractSImm(info.word);
+        break;
+      case OpcodeEnum::kBeq:
+      case OpcodeEnum::kBge:
+      case OpcodeEnum::kBgeu:
+      case OpcodeEnum::kBlt:
+      case OpcodeEnum::kBltu:
+      case OpcodeEnum::kBne:
+      case OpcodeEnum::kEbreak:
+      case OpcodeEnum::kFence:
+      case OpcodeEnum::kNone:
+        break;
+      default:
+        info.rd = inst32_format::ExtractRd(info.word);
+        break;
+    }
+  }
+  db->DecRef();
+}
+
+absl::Status RV32ITop::Wait() {
+  // If the simulator hasn't been started, then just return.
+  if (run_halted_ == nullptr) return absl::OkStatus();
+
+  // Wait for the simulator to finish - i.e., notification on run_halted_. This
+  // has to be done even if the run status is already halted, as the run
+  // thread updates the status right before it sends the notification.
   run_halted_->WaitForNotification();
   // Now delete the notification object - it is single use only.
   delete run_halted_;
@@ -274,7 +465,7 @@ absl::StatusOr<RV32ITop::RunStatus> RV32ITop::GetRunStatus() {
 }
 
 absl::StatusOr<RV32ITop::HaltReasonValueType> RV32ITop::GetLastHaltReason() {
-  return *halt_reason_;
+  return *halt_reason_.load(std::memory_order_acquire);
 }
 
 absl::StatusOr<uint64_t> RV32ITop::ReadRegister(const std::string &name) {
@@ -288,13 +479,6 @@ absl::StatusOr<uint64_t> RV32ITop::ReadRegister(const std::string &name) {
   if (iter == state_->registers()->end())
     return absl::NotFoundError(absl::StrCat("Register '", name, "' not found"));
 
-  // If requesting PC and we're stopped at a software breakpoint, the next
-  // instruction to be executed is at the address of the software breakpoint, so
-  // return that address.
-  if ((name == "pc") && (halt_reason_ == HaltReason::kSoftwareBreakpoint)) {
-    return previous_pc_;
-  }
-
   auto *db = (iter->second)->data_buffer();
   uint64_t value;
   switch (db->size<uint8_t>()) {
@@ -374,7 +558,7 @@ absl::StatusOr<size_t> RV32ITop::ReadMemory(uint64_t address, void *buffer,
   }
   auto *db = db_factory_.Allocate(length);
   // Load bypassing any watch points/semihosting.
-  state_->memory()->Load(address, db, nullptr, nullptr);
+  memory_->Load(address, db, nullptr, nullptr);
   std::memcpy(buffer, db->raw_ptr(), length);
   db->DecRef();
   return length;
@@ -389,13 +573,35 @@ absl::StatusOr<size_t> RV32ITop::WriteMemory(uint64_t address,
   auto *db = db_factory_.Allocate(length);
   std::memcpy(db->raw_ptr(), buffer, length);
   // Store bypassing any watch points/semihosting.
-  state_->memory()->Store(address, db);
+  memory_->Store(address, db);
   db->DecRef();
   return length;
 }
 
+absl::Status RV32ITop::MapFile(uint64_t address, const std::string &file_name,
+                               uint64_t offset, uint64_t file_size,
+                               uint64_t memory_size) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError("MapFile: Core must be halted");
+  }
+  if (mapped_memory_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "MapFile: Core doesn't own a mapped memory");
+  }
+  auto status = mapped_memory_->MapFile(address, file_name, offset, file_size,
+                                        memory_size);
+  if (!status.ok()) return status;
+  // The segment is part of the memory contents, e.g., for checkpoints, as if
+  // it had been stored.
+  page_tracker_->MarkTouched(address, memory_size);
+  // Any instructions decoded from the range are stale.
+  block_cache_->InvalidateAll();
+  rv32_decode_cache_->InvalidateAll();
+  return absl::OkStatus();
+}
+
 bool RV32ITop::HasBreakpoint(uint64_t address) {
-  return rv_bp_manager_->HasBreakpoint(address);
+  return block_cache_->HasBreakpoint(address);
 }
 
 absl::Status RV32ITop::SetSwBreakpoint(uint64_t address) {
@@ -404,12 +610,12 @@ absl::Status RV32ITop::SetSwBreakpoint(uint64_t address) {
     return absl::FailedPreconditionError(
         "SetSwBreakpoint: Core must be halted");
   }
-  // If there is no breakpoint manager, return an error.
-  if (rv_bp_manager_ == nullptr) {
-    return absl::InternalError("Breakpoints are not enabled");
+  if (block_cache_->HasBreakpoint(address)) {
+    return absl::AlreadyExistsError(
+        absl::StrCat("Breakpoint already set at 0x", absl::Hex(address)));
   }
-  // Try setting the breakpoint.
-  return rv_bp_manager_->SetBreakpoint(address);
+  block_cache_->SetBreakpoint(address);
+  return absl::OkStatus();
 }
 
 absl::Status RV32ITop::ClearSwBreakpoint(uint64_t address) {
@@ -418,10 +624,12 @@ absl::Status RV32ITop::ClearSwBreakpoint(uint64_t address) {
     return absl::FailedPreconditionError(
         "ClearSwBreakpoing: Core must be halted");
   }
-  if (rv_bp_manager_ == nullptr) {
-    return absl::InternalError("Breakpoints are not enabled");
+  if (!block_cache_->HasBreakpoint(address)) {
+    return absl::NotFoundError(
+        absl::StrCat("No breakpoint set at 0x", absl::Hex(address)));
   }
-  return rv_bp_manager_->ClearBreakpoint(address);
+  block_cache_->ClearBreakpoint(address);
+  return absl::OkStatus();
 }
 
 absl::Status RV32ITop::ClearAllSwBreakpoints() {
@@ -430,10 +638,7 @@ absl::Status RV32ITop::ClearAllSwBreakpoints() {
     return absl::FailedPreconditionError(
         "ClearAllSwBreakpoints: Core must be halted");
   }
-  if (rv_bp_manager_ == nullptr) {
-    return absl::InternalError("Breakpoints are not enabled");
-  }
-  rv_bp_manager_->ClearAllBreakpoints();
+  block_cache_->ClearAllBreakpoints();
   return absl::OkStatus();
 }
 
@@ -448,23 +653,9 @@ absl::StatusOr<std::string> RV32ITop::GetDisassembly(uint64_t address) {
     return absl::FailedPreconditionError("GetDissasembly: Core must be halted");
   }
 
-  Instruction *inst;
-  // If requesting the disassembly for an instruction at a breakpoint, return
-  // that of the original instruction instead.
-  if (rv_bp_manager_->IsBreakpoint(address)) {
-    auto bp_pc = address;
-    // Disable the breakpoint.
-    auto status = rv_bp_manager_->DisableBreakpoint(bp_pc);
-    if (!status.ok()) return status;
-    // Get the real instruction.
-    inst = rv32_decode_cache_->GetDecodedInstruction(bp_pc);
-    // Re-enable the breakpoint.
-    status = rv_bp_manager_->EnableBreakpoint(bp_pc);
-    if (!status.ok()) return status;
-  } else {
-    // If not at the breakpoint, or requesting a different instruction,
-    inst = rv32_decode_cache_->GetDecodedInstruction(address);
-  }
+  // Breakpoints aren't patched into memory, so this is always the original
+  // instruction.
+  Instruction *inst = rv32_decode_cache_->GetDecodedInstruction(address);
   return inst != nullptr ? inst->AsString() : "Invalid instruction";
 }
 
@@ -474,21 +665,535 @@ absl::Status RV32ITop::SetUpSemiHosting(const SemiHostAddresses &magic) {
     return absl::FailedPreconditionError(
         "SetupSemihosting: Core must be halted");
   }
+  if (semihost_requests_ != nullptr) {
+    return absl::FailedPreconditionError(
+        "SetupSemihosting: Semihosting is already set up");
+  }
   watcher_ = new util::MemoryWatcher(memory_);
+  InsertSemiHostRequests(magic, watcher_);
+  semihost_recorder_ = new SemiHostReplyRecorder(memory_, semihost_requests_);
   rv32_semihost_ = new RiscV32HtifSemiHost(
-      watcher_, memory_, magic,
+      watcher_, semihost_recorder_, magic,
       [this]() { RequestHalt(HaltReason::kSemihostHaltRequest, nullptr); },
       [this](std::string) {
         RequestHalt(HaltReason::kSemihostHaltRequest, nullptr);
       });
-  state_->set_memory(watcher_);
   return absl::OkStatus();
 }
 
+absl::Status RV32ITop::ReplaySemiHosting(const SemiHostAddresses &magic,
+                                         const SemiHostLog *log,
+                                         uint64_t first_request) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError(
+        "ReplaySemiHosting: Core must be halted");
+  }
+  if (semihost_requests_ != nullptr) {
+    return absl::FailedPreconditionError(
+        "ReplaySemiHosting: Semihosting is already set up");
+  }
+  InsertSemiHostRequests(magic, memory_);
+  semihost_requests_->StartReplay(log, first_request, memory_);
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::set_semihost_log(SemiHostLog *log) {
+  if (semihost_recorder_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "set_semihost_log: Semihosting is not set up");
+  }
+  semihost_recorder_->set_log(log);
+  return absl::OkStatus();
+}
+
+void RV32ITop::InsertSemiHostRequests(const SemiHostAddresses &magic,
+                                      util::MemoryInterface *memory) {
+  semihost_magic_ = magic;
+  semihost_requests_ = new SemiHostRequestMemory(memory, magic);
+  // Watchpoints, if any, stay in front of the semihosting requests.
+  if (state_->memory() == watchpoint_memory_) {
+    watchpoint_memory_->set_memory(semihost_requests_);
+  } else {
+    state_->set_memory(semihost_requests_);
+  }
+  UpdateHostMemory();
+}
+
+absl::Status RV32ITop::Predecode(
+    const std::vector<std::pair<uint64_t, uint64_t>> &ranges,
+    int num_threads) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError("Predecode: Core must be halted");
+  }
+  if (ranges.empty()) return absl::OkStatus();
+  uint64_t base = std::numeric_limits<uint64_t>::max();
+  uint64_t end = 0;
+  for (auto [range_start, range_end] : ranges) {
+    base = std::min(base, range_start & ~uint64_t{3});
+    end = std::max(end, range_end);
+  }
+  if (end <= base) return absl::OkStatus();
+  if (end - base > kMaxPredecodeSpan) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Predecode: Address span of ", end - base,
+                     " bytes is too large"));
+  }
+  std::vector<Instruction *> table((end - base) >> 2, nullptr);
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Looking up a register by name adds it to the state if it doesn't exist
+  // yet. The state creates the registers that the instructions refer to, but
+  // make sure of it here, before the threads start, so that decoding only
+  // reads the register map of the state.
+  (void)state_->GetRegister<RV32Register>(RiscVState::kCsrName);
+  // The decoder isn't thread safe, so each thread uses its own. They are
+  // created and deleted on this thread, as they allocate data buffers from the
+  // state.
+  std::vector<RiscV32Decoder *> decoders;
+  for (int i = 0; i < num_threads; i++) {
+    decoders.push_back(new RiscV32Decoder(state_, memory_));
+  }
+  // The threads claim chunks of the table, and decode the instructions in the
+  // chunk that lie within any of the ranges.
+  constexpr size_t kChunkSize = 4096;
+  std::atomic<size_t> next_chunk = 0;
+  auto decode = [&](RiscV32Decoder *decoder) {
+    while (true) {
+      size_t first = next_chunk.fetch_add(kChunkSize);
+      if (first >= table.size()) break;
+      size_t last = std::min(first + kChunkSize, table.size());
+      for (auto [range_start, range_end] : ranges) {
+        if (range_end <= range_start) continue;
+        size_t lo = std::max(first, (range_start - base + 3) >> 2);
+        size_t hi = std::min(last, (range_end - base) >> 2);
+        for (size_t i = lo; i < hi; i++) {
+          if (table[i] != nullptr) continue;
+          table[i] = decoder->DecodeInstruction(base + (i << 2));
+        }
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (auto *decoder : decoders) threads.emplace_back(decode, decoder);
+  for (auto &thread : threads) thread.join();
+  for (auto *decoder : decoders) delete decoder;
+  rv32_decode_cache_->SetPredecodedTable(base, std::move(table));
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::SetDataWatchpoint(uint64_t address, uint64_t length,
+                                         WatchType type) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError(
+        "SetDataWatchpoint: Core must be halted");
+  }
+  // The range must be non-empty, and lie within the 32 bit address space.
+  constexpr uint64_t kAddressSpaceSize = uint64_t{1} << 32;
+  if ((length == 0) || (address >= kAddressSpaceSize) ||
+      (length > kAddressSpaceSize - address)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("SetDataWatchpoint: Invalid range 0x", absl::Hex(address),
+                     " length ", length));
+  }
+  if (watchpoint_memory_ == nullptr) {
+    watchpoint_memory_ = new WatchpointMemory(
+        state_->memory(), [this](uint64_t address) {
+          last_watchpoint_address_ = address;
+          RequestHalt(HaltReason::kDataWatchPoint, nullptr);
+        });
+  }
+  auto status = watchpoint_memory_->SetWatchpoint(address, length, type);
+  if (!status.ok()) return status;
+  if (state_->memory() != watchpoint_memory_) {
+    // Insert the watchpoint memory in front of the memory (or the semihosting
+    // watcher) used by the instructions. Loads may now halt the core.
+    watchpoint_memory_->set_memory(state_->memory());
+    state_->set_memory(watchpoint_memory_);
+    block_cache_->set_loads_may_halt(true);
+  }
+  UpdateHostMemory();
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::ClearDataWatchpoint(uint64_t address) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError(
+        "ClearDataWatchpoint: Core must be halted");
+  }
+  if (watchpoint_memory_ == nullptr) {
+    return absl::NotFoundError(
+        absl::StrCat("No watchpoint set at 0x", absl::Hex(address)));
+  }
+  auto status = watchpoint_memory_->ClearWatchpoint(address);
+  if (!status.ok()) return status;
+  RemoveWatchpointMemoryIfEmpty();
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::ClearAllDataWatchpoints() {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError(
+        "ClearAllDataWatchpoints: Core must be halted");
+  }
+  if (watchpoint_memory_ == nullptr) return absl::OkStatus();
+  watchpoint_memory_->ClearAllWatchpoints();
+  RemoveWatchpointMemoryIfEmpty();
+  return absl::OkStatus();
+}
+
+void RV32ITop::RemoveWatchpointMemoryIfEmpty() {
+  UpdateHostMemory();
+  if (!watchpoint_memory_->empty()) return;
+  if (state_->memory() != watchpoint_memory_) return;
+  // Take the watchpoint memory out of the access path, so that loads and
+  // stores run at full speed again.
+  state_->set_memory(watchpoint_memory_->memory());
+  block_cache_->set_loads_may_halt(false);
+}
+
+void RV32ITop::UpdateHostMemory() {
+  static_assert(RiscVState::kHostPageShift == PageTrackingMemory::kPageShift);
+  static_assert(RiscVState::kHostPageShift == WatchpointMemory::kPageShift);
+  static_assert(RiscVState::kHostPageShift == DemandPagedMemory::kPageShift);
+  if ((mapped_memory_ == nullptr) && (paged_memory_ == nullptr)) return;
+  slow_pages_.assign(RiscVState::kNumHostPages / 64, 0);
+  auto mark_slow = [this](uint64_t address, uint64_t size) {
+    uint64_t first = address >> RiscVState::kHostPageShift;
+    uint64_t last = (address + size - 1) >> RiscVState::kHostPageShift;
+    for (uint64_t i = first; i <= last; i++) {
+      uint64_t page = i & (RiscVState::kNumHostPages - 1);
+      slow_pages_[page >> 6] |= uint64_t{1} << (page & 63);
+    }
+  };
+  // The semihosting requests are stores to the magic addresses.
+  if (semihost_requests_ != nullptr) {
+    mark_slow(semihost_magic_.tohost_ready, sizeof(uint64_t));
+    mark_slow(semihost_magic_.tohost, sizeof(uint64_t));
+    mark_slow(semihost_magic_.fromhost_ready, sizeof(uint64_t));
+    mark_slow(semihost_magic_.fromhost, sizeof(uint64_t));
+  }
+  if ((watchpoint_memory_ != nullptr) && !watchpoint_memory_->empty()) {
+    const auto &watched = watchpoint_memory_->watched_pages();
+    for (size_t i = 0; i < slow_pages_.size(); i++) {
+      slow_pages_[i] |= watched[i];
+    }
+  }
+  // Stores only go directly to pages that the page tracker has seen stored
+  // to, so that it knows which pages to save in a checkpoint.
+  if (mapped_memory_ != nullptr) {
+    state_->set_host_memory(mapped_memory_->host_base(), slow_pages_.data(),
+                            page_tracker_->touched_bitmap());
+  } else {
+    state_->set_host_pages(
+        [memory = paged_memory_](uint64_t address) {
+          return memory->GetPage(address);
+        },
+        slow_pages_.data(), page_tracker_->touched_bitmap());
+  }
+}
+
+absl::Status RV32ITop::StartTracing(TraceWriter *writer) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError("StartTracing: Core must be halted");
+  }
+  if (trace_stream_ != nullptr) {
+    return absl::FailedPreconditionError("StartTracing: Already tracing");
+  }
+  trace_stream_ = writer->AddStream();
+  trace_epoch_++;
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::StopTracing() {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError("StopTracing: Core must be halted");
+  }
+  if (trace_stream_ == nullptr) return absl::OkStatus();
+  trace_stream_->Flush();
+  trace_stream_ = nullptr;
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::SaveCheckpoint(std::ostream &os) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError("SaveCheckpoint: Core must be halted");
+  }
+  if (page_tracker_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "SaveCheckpoint: Core doesn't own its memory");
+  }
+  PublishCounters();
+  os.write(kCheckpointMagic, sizeof(kCheckpointMagic));
+
+  // Registers. Aliases refer to the same register, so only save it once.
+  absl::flat_hash_set<const void *> saved;
+  std::vector<std::pair<const std::string *, DataBuffer *>> registers;
+  for (auto &[name, reg] : *state_->registers()) {
+    if (!saved.insert(reg).second) continue;
+    registers.emplace_back(&name, reg->data_buffer());
+  }
+  WriteValue<uint32_t>(os, registers.size());
+  for (auto &[name, db] : registers) {
+    WriteString(os, *name);
+    WriteValue<uint16_t>(os, db->size<uint8_t>());
+    os.write(reinterpret_cast<const char *>(db->raw_ptr()),
+             db->size<uint8_t>());
+  }
+  WriteValue<uint32_t>(os, previous_pc_);
+  WriteValue<HaltReasonValueType>(os, *halt_reason_.load());
+
+  // Counters.
+  WriteValue<uint32_t>(os, static_cast<int>(OpcodeEnum::kPastMaxValue) + 3);
+  for (auto &counter : counter_opcode_) {
+    WriteString(os, counter.GetName());
+    WriteValue<uint64_t>(os, counter.GetValue());
+  }
+  for (auto *counter : {&counter_num_instructions_,
+                        &counter_num_fast_forwarded_, &counter_num_sampled_}) {
+    WriteString(os, counter->GetName());
+    WriteValue<uint64_t>(os, counter->GetValue());
+  }
+
+  // Semihosting.
+  WriteValue<uint8_t>(os, rv32_semihost_ != nullptr);
+  if (rv32_semihost_ != nullptr) {
+    WriteValue<uint64_t>(os, semihost_magic_.tohost_ready);
+    WriteValue<uint64_t>(os, semihost_magic_.tohost);
+    WriteValue<uint64_t>(os, semihost_magic_.fromhost_ready);
+    WriteValue<uint64_t>(os, semihost_magic_.fromhost);
+  }
+
+  // Memory. Pages that are all zeros are left out.
+  constexpr uint64_t kPageSize = PageTrackingMemory::kPageSize;
+  auto *db = db_factory_.Allocate<uint8_t>(kPageSize);
+  auto *bytes = reinterpret_cast<const char *>(db->raw_ptr());
+  for (auto address : page_tracker_->GetTouchedPages()) {
+    page_tracker_->Load(address, db, nullptr, nullptr);
+    if (std::all_of(bytes, bytes + kPageSize, [](char c) { return c == 0; })) {
+      continue;
+    }
+    WriteValue<uint32_t>(os, address);
+    os.write(bytes, kPageSize);
+  }
+  WriteValue<uint32_t>(os, kCheckpointEndOfPages);
+  db->DecRef();
+
+  if (!os.good()) return absl::InternalError("SaveCheckpoint: Write failed");
+  return absl::OkStatus();
+}
+
+absl::Status RV32ITop::RestoreCheckpoint(std::istream &is) {
+  return RestoreCheckpoint(is, /*set_up_semihosting=*/true);
+}
+
+absl::Status RV32ITop::RestoreCheckpoint(std::istream &is,
+                                         bool set_up_semihosting) {
+  if (run_status_ != RunStatus::kHalted) {
+    return absl::FailedPreconditionError(
+        "RestoreCheckpoint: Core must be halted");
+  }
+  if (page_tracker_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "RestoreCheckpoint: Core doesn't own its memory");
+  }
+  // The whole checkpoint is read and validated before any of the state is
+  // changed, so that a checkpoint that is truncated or doesn't match the core
+  // leaves the core as it was.
+  auto truncated = absl::InvalidArgumentError(
+      "RestoreCheckpoint: Checkpoint is truncated");
+  char magic[sizeof(kCheckpointMagic)];
+  is.read(magic, sizeof(magic));
+  if (!is.good() ||
+      (std::memcmp(magic, kCheckpointMagic, sizeof(kCheckpointMagic)) != 0)) {
+    return absl::InvalidArgumentError("RestoreCheckpoint: Not a checkpoint");
+  }
+
+  // Registers.
+  uint32_t num_registers;
+  if (!ReadValue(is, num_registers)) return truncated;
+  std::vector<std::pair<DataBuffer *, std::string>> registers;
+  std::string name;
+  for (uint32_t i = 0; i < num_registers; i++) {
+    uint16_t size;
+    if (!ReadString(is, name) || !ReadValue(is, size)) return truncated;
+    auto iter = state_->registers()->find(name);
+    if (iter == state_->registers()->end()) {
+      return absl::NotFoundError(
+          absl::StrCat("RestoreCheckpoint: Register '", name, "' not found"));
+    }
+    auto *db = iter->second->data_buffer();
+    if (db->size<uint8_t>() != size) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "RestoreCheckpoint: Size mismatch for register '", name, "'"));
+    }
+    std::string value(size, '\0');
+    is.read(value.data(), size);
+    if (!is.good()) return truncated;
+    registers.emplace_back(db, std::move(value));
+  }
+  uint32_t previous_pc;
+  HaltReasonValueType halt_reason;
+  if (!ReadValue(is, previous_pc) || !ReadValue(is, halt_reason)) {
+    return truncated;
+  }
+
+  // Counters.
+  absl::flat_hash_map<std::string, generic::SimpleCounter<uint64_t> *>
+      counter_map;
+  for (auto &counter : counter_opcode_) {
+    counter_map.emplace(counter.GetName(), &counter);
+  }
+  for (auto *counter : {&counter_num_instructions_,
+                        &counter_num_fast_forwarded_, &counter_num_sampled_}) {
+    counter_map.emplace(counter->GetName(), counter);
+  }
+  uint32_t num_counters;
+  if (!ReadValue(is, num_counters)) return truncated;
+  std::vector<std::pair<generic::SimpleCounter<uint64_t> *, uint64_t>>
+      counters;
+  for (uint32_t i = 0; i < num_counters; i++) {
+    uint64_t value;
+    if (!ReadString(is, name) || !ReadValue(is, value)) return truncated;
+    auto iter = counter_map.find(name);
+    if (iter == counter_map.end()) {
+      return absl::NotFoundError(
+          absl::StrCat("RestoreCheckpoint: Counter '", name, "' not found"));
+    }
+    counters.emplace_back(iter->second, value);
+  }
+
+  // Semihosting.
+  uint8_t has_semihost;
+  if (!ReadValue(is, has_semihost)) return truncated;
+  SemiHostAddresses magic_addresses;
+  if (has_semihost) {
+    if (!ReadValue(is, magic_addresses.tohost_ready) ||
+        !ReadValue(is, magic_addresses.tohost) ||
+        !ReadValue(is, magic_addresses.fromhost_ready) ||
+        !ReadValue(is, magic_addresses.fromhost)) {
+      return truncated;
+    }
+  }
+
+  // Memory. The page contents are kept back to back in a single buffer.
+  constexpr uint64_t kPageSize = PageTrackingMemory::kPageSize;
+  std::vector<uint32_t> page_addresses;
+  std::string page_data;
+  while (true) {
+    uint32_t address;
+    if (!ReadValue(is, address)) return truncated;
+    if (address == kCheckpointEndOfPages) break;
+    if ((address & (kPageSize - 1)) != 0) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "RestoreCheckpoint: Page address 0x", absl::Hex(address),
+          " isn't page aligned"));
+    }
+    size_t offset = page_data.size();
+    page_data.resize(offset + kPageSize);
+    is.read(page_data.data() + offset, kPageSize);
+    if (!is.good()) return truncated;
+    page_addresses.push_back(address);
+  }
+
+  // The checkpoint is complete, so it can now be applied. Semihosting is set
+  // up first, as it is the only step that can fail.
+  if (has_semihost && set_up_semihosting && !has_semihosting()) {
+    auto status = SetUpSemiHosting(magic_addresses);
+    if (!status.ok()) return status;
+  }
+  for (auto &[db, value] : registers) {
+    std::memcpy(db->raw_ptr(), value.data(), value.size());
+  }
+  previous_pc_ = previous_pc;
+  halt_reason_ = static_cast<HaltReason>(halt_reason);
+  for (auto &[counter, value] : counters) counter->SetValue(value);
+  std::fill(std::begin(opcode_counts_), std::end(opcode_counts_), 0);
+  num_unpublished_ = 0;
+  num_fast_forwarded_ = 0;
+
+  // Pages that were touched, but aren't in the checkpoint, are cleared.
+  auto previously_touched = page_tracker_->GetTouchedPages();
+  absl::flat_hash_set<uint64_t> restored;
+  auto *db = db_factory_.Allocate<uint8_t>(kPageSize);
+  for (size_t i = 0; i < page_addresses.size(); i++) {
+    std::memcpy(db->raw_ptr(), page_data.data() + i * kPageSize, kPageSize);
+    page_tracker_->Store(page_addresses[i], db);
+    restored.insert(page_addresses[i]);
+  }
+  std::memset(db->raw_ptr(), 0, kPageSize);
+  for (auto address : previously_touched) {
+    if (!restored.contains(address)) page_tracker_->Store(address, db);
+  }
+  db->DecRef();
+
+  // Any cached instructions may be stale.
+  block_cache_->InvalidateAll();
+  rv32_decode_cache_->InvalidateAll();
+  return absl::OkStatus();
+}
+
+void RV32ITop::PublishCounters() {
+  uint64_t total = 0;
+  for (int i = 0; i < static_cast<int>(OpcodeEnum::kPastMaxValue); i++) {
+    if (opcode_counts_[i] == 0) continue;
+    counter_opcode_[i].Increment(opcode_counts_[i]);
+    total += opcode_counts_[i];
+    opcode_counts_[i] = 0;
+  }
+  if (total > 0) counter_num_instructions_.Increment(total);
+  if (num_fast_forwarded_ > 0) {
+    counter_num_fast_forwarded_.Increment(num_fast_forwarded_);
+    num_fast_forwarded_ = 0;
+  }
+  num_unpublished_ = 0;
+  rv32_decode_cache_->PublishCounters();
+}
+
+void RV32ITop::ResetCounters() {
+  std::fill(std::begin(opcode_counts_), std::end(opcode_counts_), 0);
+  num_unpublished_ = 0;
+  num_fast_forwarded_ = 0;
+  for (auto &counter : counter_opcode_) counter.SetValue(0);
+  counter_num_instructions_.SetValue(0);
+  counter_num_fast_forwarded_.SetValue(0);
+  counter_num_sampled_.SetValue(0);
+  rv32_decode_cache_->ResetCounters();
+}
+
+void RV32ITop::ExtrapolateCounters() {
+  PublishCounters();
+  uint64_t sampled = counter_num_instructions_.GetValue();
+  uint64_t total = sampled + counter_num_fast_forwarded_.GetValue();
+  counter_num_sampled_.Increment(sampled);
+  counter_num_fast_forwarded_.SetValue(0);
+  counter_num_instructions_.SetValue(total);
+  if (sampled == 0) return;
+  double scale = static_cast<double>(total) / static_cast<double>(sampled);
+  for (auto &counter : counter_opcode_) {
+    counter.SetValue(std::llround(counter.GetValue() * scale));
+  }
+}
+
+void RV32ITop::AccumulateCounters(const RV32ITop &other) {
+  for (int i = 0; i < static_cast<int>(OpcodeEnum::kPastMaxValue); i++) {
+    counter_opcode_[i].Increment(other.counter_opcode_[i].GetValue());
+  }
+  counter_num_instructions_.Increment(
+      other.counter_num_instructions_.GetValue());
+  counter_num_fast_forwarded_.Increment(
+      other.counter_num_fast_forwarded_.GetValue());
+  counter_num_sampled_.Increment(other.counter_num_sampled_.GetValue());
+  rv32_decode_cache_->AccumulateCounters(*other.rv32_decode_cache_);
+}
+
 void RV32ITop::RequestHalt(HaltReason halt_reason, const Instruction *inst) {
-  // First set the halt_reason_, then the half flag.
-  halt_reason_ = halt_reason;
-  halted_ = true;
+  // First set the halt_reason_, then the halt flag. The release ordering makes
+  // sure the halt reason is visible once the flag is seen to be set. This may
+  // be called from a signal handler, which is safe as the atomics are lock
+  // free.
+  halt_reason_.store(halt_reason, std::memory_order_relaxed);
+  halted_.store(true, std::memory_order_release);
 }
 
 }  // namespace codelab
@@ -17,20 +17,33 @@
 #ifndef MPACT_SIM_CODELABS_OTHER_RV32I_TOP_H_
 #define MPACT_SIM_CODELABS_OTHER_RV32I_TOP_H_
 
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/synchronization/notification.h"
 #include "mpact/sim/generic/component.h"
 #include "mpact/sim/generic/core_debug_interface.h"
-#include "mpact/sim/generic/decode_cache.h"
 #include "mpact/sim/util/memory/flat_demand_memory.h"
 #include "mpact/sim/util/memory/memory_interface.h"
 #include "mpact/sim/util/memory/memory_watcher.h"
+#include "other/adaptive_decode_cache.h"
+#include "other/basic_block_cache.h"
+#include "other/demand_paged_memory.h"
+#include "other/mapped_memory.h"
+#include "other/page_tracking_memory.h"
 #include "other/riscv_simple_state.h"
+#include "other/semihost_replay.h"
+#include "other/threaded_interpreter.h"
+#include "other/trace_writer.h"
+#include "other/watchpoint_memory.h"
 #include "riscv/riscv32_htif_semihost.h"
-#include "riscv/riscv_action_point.h"
-#include "riscv/riscv_breakpoint.h"
 #include "riscv/riscv_register.h"
 #include "riscv_full_decoder/solution/riscv32_decoder.h"
 #include "riscv_isa_decoder/solution/riscv32i_enums.h"
@@ -40,8 +53,6 @@ namespace sim {
 namespace codelab {
 
 using riscv::RiscV32HtifSemiHost;
-using riscv::RiscVBreakpointManager;
-using riscv::RiscVActionPointManager;
 using riscv::RiscVState;
 using riscv::RV32Register;
 
@@ -53,8 +64,35 @@ class RV32ITop : public generic::Component, public generic::CoreDebugInterface {
   using RunStatus = generic::CoreDebugInterface::RunStatus;
   using HaltReasonValueType = generic::CoreDebugInterface::HaltReasonValueType;
   using SemiHostAddresses = RiscV32HtifSemiHost::SemiHostAddresses;
+  using WatchType = WatchpointMemory::WatchType;
 
+  // Halt reason used when the core stops due to the instruction limit.
+  static constexpr HaltReason kInstructionLimitHaltReason =
+      HaltReason::kUserSpecifiedMin;
+
+  // The kind of memory a core creates when it owns its memory.
+  enum class MemoryKind {
+    // util::FlatDemandMemory: memory blocks are allocated as they are first
+    // accessed. All loads and stores go through the memory interface, as it
+    // doesn't expose its blocks.
+    kFlatDemand,
+    // Host pages are allocated as they are first stored to, and the
+    // instructions access them directly through a cache of page addresses.
+    // It has the same semantics as kFlatDemand for the 32 bit address space,
+    // and is the default.
+    kDemandPaged,
+    // The address space is reserved up front in host memory, and files can
+    // be mapped into it (see MapFile).
+    kMapped,
+  };
+
+  // Constructs a core that owns a memory of the given kind, by default a
+  // DemandPagedMemory.
   explicit RV32ITop(std::string name);
+  RV32ITop(std::string name, MemoryKind memory_kind);
+  // Constructs a core that uses the given memory, which is not owned by the
+  // core, and may be shared with other cores.
+  RV32ITop(std::string name, util::MemoryInterface *memory);
   ~RV32ITop() override;
 
   // Methods inherited from CoreDebugInterface.
@@ -75,6 +113,12 @@ class RV32ITop : public generic::Component, public generic::CoreDebugInterface {
                                     size_t length) override;
   absl::StatusOr<size_t> WriteMemory(uint64_t address, const void *buf,
                                      size_t length) override;
+  // Sets [address, address + memory_size) to the file_size bytes at offset in
+  // the file followed by zeros, by mapping the file copy-on-write, e.g., to
+  // load an elf segment without copying it. The core must own a mapped memory.
+  absl::Status MapFile(uint64_t address, const std::string &file_name,
+                       uint64_t offset, uint64_t file_size,
+                       uint64_t memory_size);
 
   bool HasBreakpoint(uint64_t address) override;
   absl::Status SetSwBreakpoint(uint64_t address) override;
@@ -85,46 +129,249 @@ class RV32ITop : public generic::Component, public generic::CoreDebugInterface {
 
   absl::StatusOr<std::string> GetDisassembly(uint64_t address) override;
 
+  // Runs the core on the calling thread, and returns when it halts. Other
+  // threads may call Halt() to stop it.
+  absl::Status RunToHalt();
+
   // Set up semihosting with the given magic addresses.
   absl::Status SetUpSemiHosting(const SemiHostAddresses &magic);
+  // Instead of setting up semihosting, replays the semihosting replies
+  // recorded in the log, starting with request number first_request, so that
+  // a part of the program can be re-simulated without repeating the side
+  // effects of the semihost (see other/semihost_replay.h).
+  absl::Status ReplaySemiHosting(const SemiHostAddresses &magic,
+                                 const SemiHostLog *log,
+                                 uint64_t first_request);
+  // While the log is non-null, the replies of the semihost are recorded in
+  // it. Requires semihosting to be set up.
+  absl::Status set_semihost_log(SemiHostLog *log);
+  // True if semihosting is set up or replayed, and the magic addresses.
+  bool has_semihosting() const { return semihost_requests_ != nullptr; }
+  const SemiHostAddresses &semihost_magic() const { return semihost_magic_; }
+  // Number of semihosting requests the program made since semihosting was set
+  // up (or since the first replayed request).
+  uint64_t num_semihost_requests() const {
+    return semihost_requests_ == nullptr ? 0
+                                         : semihost_requests_->num_requests();
+  }
+
+  // Decodes all instructions in the address ranges [start, end), e.g., the
+  // executable segments of the program, in parallel on num_threads host
+  // threads (0 - one per host cpu). The instructions are stored in a table
+  // that the decode cache indexes directly, so they never have to be decoded
+  // while the program runs. The core must be halted, and the program loaded.
+  absl::Status Predecode(
+      const std::vector<std::pair<uint64_t, uint64_t>> &ranges,
+      int num_threads);
+
+  // Data watchpoints. The core halts with HaltReason::kDataWatchPoint right
+  // after an instruction whose load or store hits the watched range
+  // [address, address + length), which must be non-empty and lie within the
+  // 32 bit address space. Accesses made through ReadMemory and
+  // WriteMemory don't trigger watchpoints. While no watchpoints are set, they
+  // add no cost to memory accesses.
+  absl::Status SetDataWatchpoint(uint64_t address, uint64_t length,
+                                 WatchType type);
+  // Clears the watchpoint that starts at the address.
+  absl::Status ClearDataWatchpoint(uint64_t address);
+  absl::Status ClearAllDataWatchpoints();
+  // Address of the access that hit a watchpoint when the core last halted
+  // with HaltReason::kDataWatchPoint.
+  uint64_t last_watchpoint_address() const { return last_watchpoint_address_; }
+
+  // Starts recording a trace of the instructions executed by the core in a new
+  // stream of the trace writer. Tracing bypasses the threaded interpreter.
+  absl::Status StartTracing(TraceWriter *writer);
+  // Stops tracing, and flushes the trace stream.
+  absl::Status StopTracing();
+  // While paused, the instructions executed aren't traced, and the core runs
+  // at full speed. The trace resumes with the next instruction executed.
+  void set_trace_paused(bool value) { trace_paused_ = value; }
+  bool trace_paused() const { return trace_paused_; }
+
+  // Saves the complete simulation state to a compact binary checkpoint: all
+  // registers, the touched memory pages, the counters, and the semihosting
+  // set up. The core must be halted, and must own its memory.
+  absl::Status SaveCheckpoint(std::ostream &os);
+  // Restores the simulation state from a checkpoint saved by SaveCheckpoint.
+  // The core must be halted, and must own its memory. Memory that was touched
+  // since the checkpoint was saved, but that isn't part of it, is cleared.
+  // Software breakpoints remain set. If the checkpoint is truncated or doesn't
+  // match the core, an error is returned and the core is left unchanged.
+  absl::Status RestoreCheckpoint(std::istream &is);
+  // Same as above, but semihosting is only set up from the checkpoint if
+  // set_up_semihosting is true.
+  absl::Status RestoreCheckpoint(std::istream &is, bool set_up_semihosting);
+
+  // Instruction counts are accumulated in plain per-opcode histograms while
+  // the simulator executes, and are added to the component counters when the
+  // core halts, or every counter_publish_interval instructions while it runs
+  // (if non-zero). The counters are therefore always up to date when the core
+  // is halted, which is the only time they can be exported.
+  void PublishCounters();
+  // Sets all counters to zero.
+  void ResetCounters();
+  // Scales the counters of the instructions executed while collecting
+  // statistics up to the total number of instructions executed, including
+  // those executed while fast forwarding. The result estimates the counts for
+  // the whole run. The number of instructions sampled is kept in the
+  // num_sampled_instructions counter.
+  void ExtrapolateCounters();
+  // Adds the counter values of the other core to the counters of this core.
+  // Both cores must be halted.
+  void AccumulateCounters(const RV32ITop &other);
+  // Returns the number of instructions executed (with or without collecting
+  // statistics) as of the last time the counters were published, which is
+  // always up to date when halted.
+  uint64_t num_instructions() const {
+    return counter_num_instructions_.GetValue() +
+           counter_num_fast_forwarded_.GetValue();
+  }
 
   // Accessors.
+  // When enabled, Run() executes basic blocks using the threaded interpreter
+  // instead of calling Instruction::Execute for each instruction.
+  void set_use_threaded_interpreter(bool value) {
+    use_threaded_interpreter_ = value;
+  }
+  bool use_threaded_interpreter() const { return use_threaded_interpreter_; }
+  void set_counter_publish_interval(uint64_t value) {
+    counter_publish_interval_ = value;
+  }
+  uint64_t counter_publish_interval() const {
+    return counter_publish_interval_;
+  }
+  // When disabled, the core fast forwards: only the number of instructions is
+  // counted (in num_fast_forwarded_instructions), not the per opcode counts.
+  void set_collect_statistics(bool value) { collect_statistics_ = value; }
+  bool collect_statistics() const { return collect_statistics_; }
+  // If non-zero, Run() halts (with kInstructionLimitHaltReason) after
+  // executing this many instructions.
+  void set_instruction_limit(uint64_t value) { instruction_limit_ = value; }
+  uint64_t instruction_limit() const { return instruction_limit_; }
   RiscVState *state() const { return state_; }
+  // The decode cache can be configured while the core is halted.
+  AdaptiveDecodeCache *decode_cache() const { return rv32_decode_cache_; }
   util::MemoryInterface *memory() const { return memory_; }
 
  private:
-  // Called when a halt is requested.
+  RV32ITop(std::string name, util::MemoryInterface *memory,
+           MemoryKind memory_kind);
+
+  // Largest address span that may be predecoded.
+  static constexpr uint64_t kMaxPredecodeSpan = 64 * 1024 * 1024;
+  // Instruction count passed to Execute() to run until a halt is requested.
+  static constexpr uint64_t kUnbounded = std::numeric_limits<uint64_t>::max();
+
+  // Called when a halt is requested. All halt requests (user, semihosting,
+  // breakpoints, instruction limit) go through this method. Halt requests made
+  // from other threads are seen by the run loop at the next basic block
+  // boundary, so the halt latency is bounded by the maximum block length.
   void RequestHalt(HaltReason halt_reason, const Instruction *inst);
+  // Checks that the core can run. On success the core is in the running
+  // state.
+  absl::Status PrepareRun();
+  // Executes until a halt is requested, or the instruction limit is reached,
+  // then sets the core to halted.
+  void RunLoop();
+  // Single execution core used by both Step() and Run(). Executes basic blocks
+  // starting at start_pc until a halt is requested, a software breakpoint is
+  // reached, or max_count instructions (unless kUnbounded) have executed.
+  // Updates the pc register and previous_pc_, and returns the number of
+  // instructions executed.
+  uint64_t Execute(uint32_t start_pc, uint64_t max_count);
+  // Implements Execute, specialized for whether max_count is checked, and for
+  // whether the instructions are traced.
+  template <bool kBounded, bool kInstrumented>
+  uint64_t ExecuteBlocks(uint32_t start_pc, uint64_t max_count);
+  // Executes up to max_count instructions of the block, recording them in the
+  // trace. Returns the number of instructions executed.
+  int ExecuteTraced(BasicBlock *block, uint64_t max_count);
+  // Fills in the trace information of the block.
+  void LowerTraceInfo(BasicBlock *block);
+  // Removes the watchpoint memory from the memory access path once it no
+  // longer holds any watchpoints.
+  void RemoveWatchpointMemoryIfEmpty();
+  // Inserts the semihosting request memory in front of the given memory, in
+  // the memory access path of the instructions.
+  void InsertSemiHostRequests(const SemiHostAddresses &magic,
+                              util::MemoryInterface *memory);
+  // Recomputes the pages that can't be accessed directly by the instructions,
+  // and passes them to the state along with the host memory, if the core owns
+  // a mapped or demand paged memory. Called whenever semihosting or
+  // watchpoints change.
+  void UpdateHostMemory();
+  uint32_t ReadXreg(int num) const { return state_->ReadXreg(num); }
 
   uint32_t previous_pc_;
   // The DB factory is used to manage data buffers for memory read/writes.
   generic::DataBufferFactory db_factory_;
-  // Current status and last halt reasons.
-  RunStatus run_status_ = RunStatus::kHalted;
-  HaltReason halt_reason_ = HaltReason::kNone;
+  // Current status and last halt reasons. These are accessed both by the run
+  // thread and the thread controlling the simulator.
+  std::atomic<RunStatus> run_status_ = RunStatus::kHalted;
+  std::atomic<HaltReason> halt_reason_ = HaltReason::kNone;
   // Halting flag. This is set to true when execution must halt.
-  bool halted_ = false;
+  std::atomic<bool> halted_ = false;
   absl::Notification *run_halted_ = nullptr;
   // The local RiscV32 state.
   RiscVState *state_;
-  // Semihosting class.
+  // Semihosting class, and the addresses it was set up with. The request
+  // memory numbers the requests the instructions make, and the recorder
+  // records the semihost's replies to them. When replaying, there is no
+  // semihost, and the request memory stores the replies.
   RiscV32HtifSemiHost *rv32_semihost_ = nullptr;
-  // Action point manager.
-  RiscVActionPointManager *rv_ap_manager_ = nullptr;
-  // Breakpoint manager.
-  RiscVBreakpointManager *rv_bp_manager_ = nullptr;
+  SemiHostAddresses semihost_magic_ = {};
+  SemiHostRequestMemory *semihost_requests_ = nullptr;
+  SemiHostReplyRecorder *semihost_recorder_ = nullptr;
+  // True if the next execution resumes from a software breakpoint, and so
+  // must not halt at it again. Software breakpoints themselves are kept by the
+  // basic block cache.
+  bool step_over_breakpoint_ = false;
   // The pc register instance.
   RV32Register *pc_;
   // RiscV32 decoder instance.
   RiscV32Decoder *rv32_decoder_ = nullptr;
-  // Decode cache, memory and memory watcher.
-  generic::DecodeCache *rv32_decode_cache_ = nullptr;
-  util::FlatDemandMemory *memory_ = nullptr;
+  // Decode cache, basic block cache, memory and memory watcher.
+  AdaptiveDecodeCache *rv32_decode_cache_ = nullptr;
+  BasicBlockCache *block_cache_ = nullptr;
+  // Threaded interpreter, used by Run() if use_threaded_interpreter_ is true.
+  ThreadedInterpreter *threaded_interpreter_ = nullptr;
+  bool use_threaded_interpreter_ = false;
+  // Trace stream, non-null while tracing. The epoch is incremented each time
+  // tracing starts, so that each trace records the instruction words anew.
+  TraceStream *trace_stream_ = nullptr;
+  uint64_t trace_epoch_ = 0;
+  bool trace_paused_ = false;
+  util::MemoryInterface *memory_ = nullptr;
+  // Non-null if the core owns its memory. The page tracker wraps the owned
+  // memory to keep track of the pages to save in a checkpoint.
+  util::MemoryInterface *owned_memory_ = nullptr;
+  // The owned memory if it is a mapped memory.
+  MappedMemory *mapped_memory_ = nullptr;
+  // The owned memory if it is a demand paged memory.
+  DemandPagedMemory *paged_memory_ = nullptr;
+  // Pages of the owned memory that loads and stores can't access directly,
+  // one bit per page.
+  std::vector<uint64_t> slow_pages_;
+  PageTrackingMemory *page_tracker_ = nullptr;
   util::MemoryWatcher *watcher_ = nullptr;
+  // Created when the first data watchpoint is set, and only in the memory
+  // access path of the instructions while it holds any watchpoints.
+  WatchpointMemory *watchpoint_memory_ = nullptr;
+  uint64_t last_watchpoint_address_ = 0;
+  // Instruction counts that have not yet been added to the counters below.
+  uint64_t opcode_counts_[static_cast<int>(OpcodeEnum::kPastMaxValue)] = {};
+  uint64_t num_unpublished_ = 0;
+  uint64_t num_fast_forwarded_ = 0;
+  bool collect_statistics_ = true;
+  uint64_t counter_publish_interval_ = 0;
+  uint64_t instruction_limit_ = 0;
   // Counter for the number of instructions simulated.
   generic::SimpleCounter<uint64_t>
       counter_opcode_[static_cast<int>(OpcodeEnum::kPastMaxValue)];
   generic::SimpleCounter<uint64_t> counter_num_instructions_;
+  generic::SimpleCounter<uint64_t> counter_num_fast_forwarded_;
+  generic::SimpleCounter<uint64_t> counter_num_sampled_;
 };
 
 }  // namespace codelab
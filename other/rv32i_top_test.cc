@@ -0,0 +1,94 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/rv32i_top.h"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using ::mpact::sim::codelab::RV32ITop;
+
+constexpr uint64_t kDataAddress = 0x1000;
+constexpr uint64_t kOtherAddress = 0x8000;
+
+uint32_t ReadWord(RV32ITop &top, uint64_t address) {
+  uint32_t value = 0;
+  EXPECT_TRUE(top.ReadMemory(address, &value, sizeof(value)).ok());
+  return value;
+}
+
+void WriteWord(RV32ITop &top, uint64_t address, uint32_t value) {
+  EXPECT_TRUE(top.WriteMemory(address, &value, sizeof(value)).ok());
+}
+
+// Returns a checkpoint of a core with a few registers and memory words set.
+std::string SaveTestCheckpoint() {
+  RV32ITop top("saved");
+  EXPECT_TRUE(top.WriteRegister("a0", 0x1234).ok());
+  EXPECT_TRUE(top.WriteRegister("sp", 0x8000'0000).ok());
+  EXPECT_TRUE(top.WriteRegister("pc", 0x100).ok());
+  WriteWord(top, kDataAddress, 0xdead'beef);
+  WriteWord(top, kDataAddress + 0x2000, 0x55aa'55aa);
+  std::stringstream stream;
+  EXPECT_TRUE(top.SaveCheckpoint(stream).ok());
+  return stream.str();
+}
+
+TEST(RV32ITopCheckpointTest, RoundTrip) {
+  std::string checkpoint = SaveTestCheckpoint();
+  RV32ITop top("restored");
+  // A page that isn't in the checkpoint is cleared by the restore.
+  WriteWord(top, kOtherAddress, 0x1111'1111);
+  std::stringstream stream(checkpoint);
+  ASSERT_TRUE(top.RestoreCheckpoint(stream).ok());
+  EXPECT_EQ(top.ReadRegister("a0").value(), 0x1234);
+  EXPECT_EQ(top.ReadRegister("x10").value(), 0x1234);
+  EXPECT_EQ(top.ReadRegister("sp").value(), 0x8000'0000);
+  EXPECT_EQ(top.ReadRegister("pc").value(), 0x100);
+  EXPECT_EQ(ReadWord(top, kDataAddress), 0xdead'beef);
+  EXPECT_EQ(ReadWord(top, kDataAddress + 0x2000), 0x55aa'55aa);
+  EXPECT_EQ(ReadWord(top, kOtherAddress), 0);
+
+  // Saving the restored core gives the same checkpoint.
+  std::stringstream saved;
+  ASSERT_TRUE(top.SaveCheckpoint(saved).ok());
+  EXPECT_EQ(saved.str(), checkpoint);
+}
+
+TEST(RV32ITopCheckpointTest, TruncatedCheckpointLeavesCoreUnchanged) {
+  std::string checkpoint = SaveTestCheckpoint();
+  // Cut the checkpoint in the registers, the counters and the memory pages.
+  for (size_t size : {size_t{4}, size_t{64}, checkpoint.size() / 2,
+                      checkpoint.size() - 1}) {
+    RV32ITop top("restored");
+    ASSERT_TRUE(top.WriteRegister("a0", 42).ok());
+    ASSERT_TRUE(top.WriteRegister("pc", 0x200).ok());
+    WriteWord(top, kDataAddress, 7);
+    WriteWord(top, kOtherAddress, 9);
+    std::stringstream stream(checkpoint.substr(0, size));
+    EXPECT_FALSE(top.RestoreCheckpoint(stream).ok()) << "size " << size;
+    EXPECT_EQ(top.ReadRegister("a0").value(), 42) << "size " << size;
+    EXPECT_EQ(top.ReadRegister("pc").value(), 0x200) << "size " << size;
+    EXPECT_EQ(ReadWord(top, kDataAddress), 7) << "size " << size;
+    EXPECT_EQ(ReadWord(top, kOtherAddress), 9) << "size " << size;
+  }
+}
+
+}  // namespace
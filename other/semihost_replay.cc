@@ -0,0 +1,122 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/semihost_replay.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+SemiHostRequestMemory::SemiHostRequestMemory(util::MemoryInterface *memory,
+                                             const SemiHostAddresses &magic)
+    : memory_(memory), magic_(magic) {}
+
+void SemiHostRequestMemory::StartReplay(const SemiHostLog *log,
+                                        uint64_t first_request,
+                                        util::MemoryInterface *reply_memory) {
+  log_ = log;
+  reply_memory_ = reply_memory;
+  num_requests_ = first_request;
+  // The stores are ordered by request.
+  auto iter = std::lower_bound(
+      log_->stores.begin(), log_->stores.end(), first_request,
+      [](const SemiHostLog::Store &store, uint64_t request) {
+        return store.request < request;
+      });
+  next_store_ = iter - log_->stores.begin();
+}
+
+bool SemiHostRequestMemory::IsRequest(uint64_t address, uint64_t size) const {
+  for (uint64_t magic : {magic_.tohost_ready, magic_.tohost,
+                         magic_.fromhost_ready, magic_.fromhost}) {
+    if ((address < magic + sizeof(uint64_t)) && (magic < address + size)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SemiHostRequestMemory::Load(uint64_t address, DataBuffer *db,
+                                 Instruction *inst, ReferenceCount *context) {
+  memory_->Load(address, db, inst, context);
+}
+
+void SemiHostRequestMemory::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                                 int el_size, DataBuffer *db,
+                                 Instruction *inst, ReferenceCount *context) {
+  memory_->Load(address_db, mask_db, el_size, db, inst, context);
+}
+
+void SemiHostRequestMemory::Store(uint64_t address, DataBuffer *db) {
+  if (!IsRequest(address, db->size<uint8_t>())) {
+    memory_->Store(address, db);
+    return;
+  }
+  uint64_t request = num_requests_++;
+  memory_->Store(address, db);
+  if (log_ == nullptr) return;
+  auto &stores = log_->stores;
+  while ((next_store_ < stores.size()) &&
+         (stores[next_store_].request == request)) {
+    auto &store = stores[next_store_++];
+    auto *reply_db = db_factory_.Allocate<uint8_t>(store.data.size());
+    std::memcpy(reply_db->raw_ptr(), store.data.data(), store.data.size());
+    reply_memory_->Store(store.address, reply_db);
+    reply_db->DecRef();
+  }
+}
+
+void SemiHostRequestMemory::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                                  int el_size, DataBuffer *db) {
+  memory_->Store(address_db, mask_db, el_size, db);
+}
+
+void SemiHostReplyRecorder::Load(uint64_t address, DataBuffer *db,
+                                 Instruction *inst, ReferenceCount *context) {
+  memory_->Load(address, db, inst, context);
+}
+
+void SemiHostReplyRecorder::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                                 int el_size, DataBuffer *db,
+                                 Instruction *inst, ReferenceCount *context) {
+  memory_->Load(address_db, mask_db, el_size, db, inst, context);
+}
+
+void SemiHostReplyRecorder::Store(uint64_t address, DataBuffer *db) {
+  memory_->Store(address, db);
+  if (log_ == nullptr) return;
+  log_->stores.push_back(
+      {requests_->current_request(), address,
+       std::string(static_cast<const char *>(db->raw_ptr()),
+                   db->size<uint8_t>())});
+}
+
+void SemiHostReplyRecorder::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                                  int el_size, DataBuffer *db) {
+  // The semihost only makes scalar stores.
+  memory_->Store(address_db, mask_db, el_size, db);
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
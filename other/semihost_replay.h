@@ -0,0 +1,129 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_SEMIHOST_REPLAY_H_
+#define MPACT_SIM_CODELABS_OTHER_SEMIHOST_REPLAY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+#include "riscv/riscv32_htif_semihost.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::Instruction;
+using ::mpact::sim::generic::ReferenceCount;
+
+// The program makes a semihosting request by storing to one of the magic
+// addresses, and the semihost replies by storing to guest memory, e.g., the
+// result of a system call and the fromhost flags. Besides the replies, a
+// request may have side effects on the host, such as program output. To
+// re-simulate a part of the program without repeating those side effects, the
+// replies are recorded in a log while the program first runs, and are stored
+// again at the same requests when re-simulating, without a semihost.
+struct SemiHostLog {
+  struct Store {
+    // Index of the request, counting from the start of the program.
+    uint64_t request;
+    uint64_t address;
+    std::string data;
+  };
+  // In the order the semihost made them.
+  std::vector<Store> stores;
+};
+
+// Memory interface wrapper in front of the memory (or semihosting watcher)
+// used by the instructions, that numbers the requests. When replaying a log,
+// the recorded replies to each request are stored right after the request.
+// The wrapper doesn't own the memory.
+class SemiHostRequestMemory : public util::MemoryInterface {
+ public:
+  using SemiHostAddresses = riscv::RiscV32HtifSemiHost::SemiHostAddresses;
+
+  SemiHostRequestMemory(util::MemoryInterface *memory,
+                        const SemiHostAddresses &magic);
+
+  // Replays the log, starting with request number first_request. The replies
+  // are stored to reply_memory.
+  void StartReplay(const SemiHostLog *log, uint64_t first_request,
+                   util::MemoryInterface *reply_memory);
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+  // Number of requests made so far, and the index of the request being made
+  // (only valid while it is).
+  uint64_t num_requests() const { return num_requests_; }
+  uint64_t current_request() const { return num_requests_ - 1; }
+
+ private:
+  bool IsRequest(uint64_t address, uint64_t size) const;
+
+  util::MemoryInterface *memory_;
+  SemiHostAddresses magic_;
+  uint64_t num_requests_ = 0;
+  // Replay state.
+  const SemiHostLog *log_ = nullptr;
+  size_t next_store_ = 0;
+  util::MemoryInterface *reply_memory_ = nullptr;
+  generic::DataBufferFactory db_factory_;
+};
+
+// Memory interface wrapper used by the semihost, that records its stores in a
+// log (if set), as replies to the current request. The wrapper doesn't own
+// the memory.
+class SemiHostReplyRecorder : public util::MemoryInterface {
+ public:
+  SemiHostReplyRecorder(util::MemoryInterface *memory,
+                        const SemiHostRequestMemory *requests)
+      : memory_(memory), requests_(requests) {}
+
+  void set_log(SemiHostLog *log) { log_ = log; }
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+ private:
+  util::MemoryInterface *memory_;
+  const SemiHostRequestMemory *requests_;
+  SemiHostLog *log_ = nullptr;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_SEMIHOST_REPLAY_H_
@@ -0,0 +1,217 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/shared_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "other/memory_load.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Copies a naturally aligned value of type T atomically from shared memory to
+// a private buffer, or the other way around.
+template <typename T>
+static inline void AtomicRead(const uint8_t *shared, uint8_t *buffer) {
+  T value =
+      __atomic_load_n(reinterpret_cast<const T *>(shared), __ATOMIC_RELAXED);
+  std::memcpy(buffer, &value, sizeof(T));
+}
+
+template <typename T>
+static inline void AtomicWrite(uint8_t *shared, const uint8_t *buffer) {
+  T value;
+  std::memcpy(&value, buffer, sizeof(T));
+  __atomic_store_n(reinterpret_cast<T *>(shared), value, __ATOMIC_RELAXED);
+}
+
+static inline bool IsAligned(const uint8_t *shared, uint64_t size) {
+  return (reinterpret_cast<uintptr_t>(shared) & (size - 1)) == 0;
+}
+
+// Copies size bytes that are within a single page.
+static void ReadShared(const uint8_t *shared, uint8_t *buffer, uint64_t size) {
+  if (IsAligned(shared, size)) {
+    switch (size) {
+      case 1:
+        return AtomicRead<uint8_t>(shared, buffer);
+      case 2:
+        return AtomicRead<uint16_t>(shared, buffer);
+      case 4:
+        return AtomicRead<uint32_t>(shared, buffer);
+      case 8:
+        return AtomicRead<uint64_t>(shared, buffer);
+      default:
+        break;
+    }
+  }
+  for (uint64_t i = 0; i < size; i++) {
+    AtomicRead<uint8_t>(shared + i, buffer + i);
+  }
+}
+
+static void WriteShared(uint8_t *shared, const uint8_t *buffer, uint64_t size) {
+  if (IsAligned(shared, size)) {
+    switch (size) {
+      case 1:
+        return AtomicWrite<uint8_t>(shared, buffer);
+      case 2:
+        return AtomicWrite<uint16_t>(shared, buffer);
+      case 4:
+        return AtomicWrite<uint32_t>(shared, buffer);
+      case 8:
+        return AtomicWrite<uint64_t>(shared, buffer);
+      default:
+        break;
+    }
+  }
+  for (uint64_t i = 0; i < size; i++) {
+    AtomicWrite<uint8_t>(shared + i, buffer + i);
+  }
+}
+
+SharedMemory::SharedMemory() = default;
+
+SharedMemory::~SharedMemory() {
+  for (auto &entry : directory_) {
+    PageEntry *table = entry.load(std::memory_order_relaxed);
+    if (table == nullptr) continue;
+    for (uint64_t i = 0; i < kTableSize; i++) {
+      delete[] table[i].load(std::memory_order_relaxed);
+    }
+    delete[] table;
+  }
+}
+
+uint8_t *SharedMemory::GetPage(uint64_t address) const {
+  uint64_t page = (address >> kPageShift) & (kNumPages - 1);
+  PageEntry *table =
+      directory_[page >> kTableShift].load(std::memory_order_acquire);
+  if (table == nullptr) return nullptr;
+  return table[page & (kTableSize - 1)].load(std::memory_order_acquire);
+}
+
+uint8_t *SharedMemory::GetOrAllocatePage(uint64_t address) {
+  uint64_t page = (address >> kPageShift) & (kNumPages - 1);
+  // Another core may publish the table or the page first, in which case the
+  // one allocated here is discarded, and the published one is used.
+  auto &table_entry = directory_[page >> kTableShift];
+  PageEntry *table = table_entry.load(std::memory_order_acquire);
+  if (table == nullptr) {
+    auto *new_table = new PageEntry[kTableSize]();
+    if (table_entry.compare_exchange_strong(table, new_table,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+      table = new_table;
+    } else {
+      delete[] new_table;
+    }
+  }
+  PageEntry &page_entry = table[page & (kTableSize - 1)];
+  uint8_t *host = page_entry.load(std::memory_order_acquire);
+  if (host == nullptr) {
+    auto *new_host = new uint8_t[kPageSize]();
+    if (page_entry.compare_exchange_strong(host, new_host,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+      host = new_host;
+    } else {
+      delete[] new_host;
+    }
+  }
+  return host;
+}
+
+void SharedMemory::Read(uint64_t address, uint8_t *buffer,
+                        uint64_t size) const {
+  while (size > 0) {
+    uint64_t offset = address & (kPageSize - 1);
+    uint64_t count = std::min(size, kPageSize - offset);
+    const uint8_t *host = GetPage(address);
+    if (host == nullptr) {
+      std::memset(buffer, 0, count);
+    } else {
+      ReadShared(host + offset, buffer, count);
+    }
+    address += count;
+    buffer += count;
+    size -= count;
+  }
+}
+
+void SharedMemory::Write(uint64_t address, const uint8_t *buffer,
+                         uint64_t size) {
+  while (size > 0) {
+    uint64_t offset = address & (kPageSize - 1);
+    uint64_t count = std::min(size, kPageSize - offset);
+    WriteShared(GetOrAllocatePage(address) + offset, buffer, count);
+    address += count;
+    buffer += count;
+    size -= count;
+  }
+}
+
+void SharedMemory::Load(uint64_t address, DataBuffer *db, Instruction *inst,
+                        ReferenceCount *context) {
+  Read(address, static_cast<uint8_t *>(db->raw_ptr()), db->size<uint8_t>());
+  FinishLoad(db, inst, context);
+}
+
+void SharedMemory::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                        int el_size, DataBuffer *db, Instruction *inst,
+                        ReferenceCount *context) {
+  int num_addresses = address_db->size<uint64_t>();
+  int num_elements = mask_db->size<bool>();
+  auto *data = static_cast<uint8_t *>(db->raw_ptr());
+  for (int i = 0; i < num_elements; i++) {
+    if (!mask_db->Get<bool>(i)) continue;
+    // A single address is the base of consecutive elements.
+    uint64_t address = num_addresses == 1
+                           ? address_db->Get<uint64_t>(0) + i * el_size
+                           : address_db->Get<uint64_t>(i);
+    Read(address, data + i * el_size, el_size);
+  }
+  FinishLoad(db, inst, context);
+}
+
+void SharedMemory::Store(uint64_t address, DataBuffer *db) {
+  Write(address, static_cast<const uint8_t *>(db->raw_ptr()),
+        db->size<uint8_t>());
+}
+
+void SharedMemory::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                         int el_size, DataBuffer *db) {
+  int num_addresses = address_db->size<uint64_t>();
+  int num_elements = mask_db->size<bool>();
+  auto *data = static_cast<const uint8_t *>(db->raw_ptr());
+  for (int i = 0; i < num_elements; i++) {
+    if (!mask_db->Get<bool>(i)) continue;
+    uint64_t address = num_addresses == 1
+                           ? address_db->Get<uint64_t>(0) + i * el_size
+                           : address_db->Get<uint64_t>(i);
+    Write(address, data + i * el_size, el_size);
+  }
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
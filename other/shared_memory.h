@@ -0,0 +1,87 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_SHARED_MEMORY_H_
+#define MPACT_SIM_CODELABS_OTHER_SHARED_MEMORY_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::Instruction;
+using ::mpact::sim::generic::ReferenceCount;
+
+// Memory for the 32 bit address space that is safe to share between cores
+// running on different threads, without taking any lock. Host pages are
+// allocated as they are first stored to, and are published in the page table
+// with a compare and swap, so a page that two cores store to at the same time
+// is only allocated once. Pages that haven't been allocated read as zero, and
+// are never released while the memory exists, so loads and stores only read
+// the page table. Naturally aligned accesses of up to 8 bytes are done as
+// single atomic (relaxed) accesses, so that a core never sees a torn value
+// stored by another core. Other accesses are copied a byte at a time, which
+// like on hardware gives no atomicity guarantee.
+class SharedMemory : public util::MemoryInterface {
+ public:
+  static constexpr int kPageShift = 12;
+  static constexpr uint64_t kPageSize = uint64_t{1} << kPageShift;
+
+  SharedMemory();
+  ~SharedMemory() override;
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+ private:
+  // Two level page table: the directory points to tables of page pointers.
+  static constexpr uint64_t kNumPages = (uint64_t{1} << 32) >> kPageShift;
+  static constexpr int kTableShift = 10;
+  static constexpr uint64_t kTableSize = uint64_t{1} << kTableShift;
+  static constexpr uint64_t kDirectorySize = kNumPages >> kTableShift;
+
+  using PageEntry = std::atomic<uint8_t *>;
+
+  // Returns the host address of the page that holds the address, or nullptr
+  // if the page hasn't been allocated.
+  uint8_t *GetPage(uint64_t address) const;
+  uint8_t *GetOrAllocatePage(uint64_t address);
+  // Copy between the address space and a host buffer.
+  void Read(uint64_t address, uint8_t *buffer, uint64_t size) const;
+  void Write(uint64_t address, const uint8_t *buffer, uint64_t size);
+
+  std::atomic<PageEntry *> directory_[kDirectorySize] = {};
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_SHARED_MEMORY_H_
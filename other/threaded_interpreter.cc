@@ -0,0 +1,273 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/threaded_interpreter.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "riscv_bin_decoder/solution/riscv32i_bin_decoder.h"
+#include "riscv_isa_decoder/solution/riscv32i_enums.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using generic::DataBuffer;
+using riscv::RiscVState;
+using riscv::RV32Register;
+
+ThreadedInterpreter::ThreadedInterpreter(RiscVState *state,
+                                         util::MemoryInterface *memory)
+    : state_(state), memory_(memory) {
+  inst_db_ = state_->db_factory()->Allocate<uint32_t>(1);
+  pc_ = state_->GetRegister<RV32Register>(RiscVState::kPcName).first;
+  for (int i = 0; i < 32; i++) xreg_values_[i] = state_->xreg_value(i);
+  // Initialize the handler table.
+  std::atomic<bool> unused_halted = false;
+  uint32_t unused_pc;
+  Execute(nullptr, unused_halted, unused_pc);
+}
+
+ThreadedInterpreter::~ThreadedInterpreter() { inst_db_->DecRef(); }
+
+int ThreadedInterpreter::ExecuteBlock(BasicBlock *block,
+                                      const std::atomic<bool> &halted,
+                                      uint32_t &next_pc) {
+  if (block->threaded_code.empty()) Lower(block);
+  return Execute(block, halted, next_pc);
+}
+
+void ThreadedInterpreter::Lower(BasicBlock *block) {
+  block->threaded_code.reserve(block->instructions.size() + 1);
+  for (auto *inst : block->instructions) {
+    ThreadedOp op;
+    op.inst = inst;
+    op.handler = handlers_[inst->opcode()];
+    if (op.handler == generic_handler_) {
+      block->threaded_code.push_back(op);
+      continue;
+    }
+    uint32_t address = inst->address();
+    memory_->Load(address, inst_db_, nullptr, nullptr);
+    uint32_t inst_word = inst_db_->Get<uint32_t>(0);
+    op.rd = inst32_format::ExtractRd(inst_word);
+    op.rs1 = inst32_format::ExtractRs1(inst_word);
+    op.rs2 = inst32_format::ExtractRs2(inst_word);
+    bool is_control_transfer = false;
+    switch (static_cast<OpcodeEnum>(inst->opcode())) {
+      case OpcodeEnum::kAddi:
+      case OpcodeEnum::kAndi:
+      case OpcodeEnum::kOri:
+      case OpcodeEnum::kXori:
+        op.imm = inst32_format::ExtractImm12(inst_word);
+        break;
+      case OpcodeEnum::kSlli:
+      case OpcodeEnum::kSrai:
+      case OpcodeEnum::kSrli:
+        op.imm = inst32_format::ExtractUimm5(inst_word);
+        break;
+      case OpcodeEnum::kLui:
+        op.imm = inst32_format::ExtractUimm32(inst_word);
+        break;
+      case OpcodeEnum::kAuipc:
+        // Auipc is just a lui of the pc relative value.
+        op.imm = inst32_format::ExtractUimm32(inst_word) + address;
+        break;
+      case OpcodeEnum::kBeq:
+      case OpcodeEnum::kBge:
+      case OpcodeEnum::kBgeu:
+      case OpcodeEnum::kBlt:
+      case OpcodeEnum::kBltu:
+      case OpcodeEnum::kBne:
+        op.imm = inst32_format::ExtractBImm(inst_word) + address;
+        is_control_transfer = true;
+        break;
+      case OpcodeEnum::kJal:
+        op.imm = inst32_format::ExtractJImm(inst_word) + address;
+        is_control_transfer = true;
+        break;
+      case OpcodeEnum::kJalr:
+        op.imm = inst32_format::ExtractImm12(inst_word);
+        is_control_transfer = true;
+        break;
+      default:
+        break;
+    }
+    // Alu instructions that write x0 have no effect.
+    if ((op.rd == 0) && !is_control_transfer) op.handler = nop_handler_;
+    block->threaded_code.push_back(op);
+  }
+  // Terminate the threaded code in case the last instruction doesn't end it.
+  ThreadedOp end_op;
+  end_op.handler = end_handler_;
+  block->threaded_code.push_back(end_op);
+}
+
+int ThreadedInterpreter::Execute(BasicBlock *block,
+                                 const std::atomic<bool> &halted,
+                                 uint32_t &next_pc) {
+  if (block == nullptr) {
+    for (auto &handler : handlers_) handler = &&generic;
+    handlers_[static_cast<int>(OpcodeEnum::kAdd)] = &&add;
+    handlers_[static_cast<int>(OpcodeEnum::kAddi)] = &&addi;
+    handlers_[static_cast<int>(OpcodeEnum::kAnd)] = &&and_;
+    handlers_[static_cast<int>(OpcodeEnum::kAndi)] = &&andi;
+    handlers_[static_cast<int>(OpcodeEnum::kOr)] = &&or_;
+    handlers_[static_cast<int>(OpcodeEnum::kOri)] = &&ori;
+    handlers_[static_cast<int>(OpcodeEnum::kXor)] = &&xor_;
+    handlers_[static_cast<int>(OpcodeEnum::kXori)] = &&xori;
+    handlers_[static_cast<int>(OpcodeEnum::kSub)] = &&sub;
+    handlers_[static_cast<int>(OpcodeEnum::kSll)] = &&sll;
+    handlers_[static_cast<int>(OpcodeEnum::kSlli)] = &&slli;
+    handlers_[static_cast<int>(OpcodeEnum::kSltu)] = &&sltu;
+    handlers_[static_cast<int>(OpcodeEnum::kSrai)] = &&srai;
+    handlers_[static_cast<int>(OpcodeEnum::kSrli)] = &&srli;
+    handlers_[static_cast<int>(OpcodeEnum::kLui)] = &&lui;
+    handlers_[static_cast<int>(OpcodeEnum::kAuipc)] = &&lui;
+    handlers_[static_cast<int>(OpcodeEnum::kBeq)] = &&beq;
+    handlers_[static_cast<int>(OpcodeEnum::kBge)] = &&bge;
+    handlers_[static_cast<int>(OpcodeEnum::kBgeu)] = &&bgeu;
+    handlers_[static_cast<int>(OpcodeEnum::kBlt)] = &&blt;
+    handlers_[static_cast<int>(OpcodeEnum::kBltu)] = &&bltu;
+    handlers_[static_cast<int>(OpcodeEnum::kBne)] = &&bne;
+    handlers_[static_cast<int>(OpcodeEnum::kJal)] = &&jal;
+    handlers_[static_cast<int>(OpcodeEnum::kJalr)] = &&jalr;
+    generic_handler_ = &&generic;
+    nop_handler_ = &&nop;
+    end_handler_ = &&end;
+    return 0;
+  }
+
+  const ThreadedOp *begin = block->threaded_code.data();
+  const ThreadedOp *op = begin;
+  DataBuffer *pc_db = pc_->data_buffer();
+
+#define DISPATCH_NEXT() goto *(++op)->handler
+
+  goto *op->handler;
+
+add:
+  WriteXreg(op->rd, ReadXreg(op->rs1) + ReadXreg(op->rs2));
+  DISPATCH_NEXT();
+addi:
+  WriteXreg(op->rd, ReadXreg(op->rs1) + op->imm);
+  DISPATCH_NEXT();
+and_:
+  WriteXreg(op->rd, ReadXreg(op->rs1) & ReadXreg(op->rs2));
+  DISPATCH_NEXT();
+andi:
+  WriteXreg(op->rd, ReadXreg(op->rs1) & op->imm);
+  DISPATCH_NEXT();
+or_:
+  WriteXreg(op->rd, ReadXreg(op->rs1) | ReadXreg(op->rs2));
+  DISPATCH_NEXT();
+ori:
+  WriteXreg(op->rd, ReadXreg(op->rs1) | op->imm);
+  DISPATCH_NEXT();
+xor_:
+  WriteXreg(op->rd, ReadXreg(op->rs1) ^ ReadXreg(op->rs2));
+  DISPATCH_NEXT();
+xori:
+  WriteXreg(op->rd, ReadXreg(op->rs1) ^ op->imm);
+  DISPATCH_NEXT();
+sub:
+  WriteXreg(op->rd, ReadXreg(op->rs1) - ReadXreg(op->rs2));
+  DISPATCH_NEXT();
+sll:
+  WriteXreg(op->rd, ReadXreg(op->rs1) << (ReadXreg(op->rs2) & 0x1f));
+  DISPATCH_NEXT();
+slli:
+  WriteXreg(op->rd, ReadXreg(op->rs1) << op->imm);
+  DISPATCH_NEXT();
+sltu:
+  WriteXreg(op->rd, ReadXreg(op->rs1) < ReadXreg(op->rs2) ? 1 : 0);
+  DISPATCH_NEXT();
+srai:
+  WriteXreg(op->rd, static_cast<int32_t>(ReadXreg(op->rs1)) >> op->imm);
+  DISPATCH_NEXT();
+srli:
+  WriteXreg(op->rd, ReadXreg(op->rs1) >> op->imm);
+  DISPATCH_NEXT();
+lui:
+  WriteXreg(op->rd, op->imm);
+  DISPATCH_NEXT();
+nop:
+  DISPATCH_NEXT();
+
+  // Branches and jumps are always the last instruction in a block, so the
+  // fall through address is the end address of the block.
+beq:
+  next_pc = ReadXreg(op->rs1) == ReadXreg(op->rs2) ? op->imm
+                                                    : block->end_address;
+  return op - begin + 1;
+bge:
+  next_pc = static_cast<int32_t>(ReadXreg(op->rs1)) >=
+                    static_cast<int32_t>(ReadXreg(op->rs2))
+                ? op->imm
+                : block->end_address;
+  return op - begin + 1;
+bgeu:
+  next_pc = ReadXreg(op->rs1) >= ReadXreg(op->rs2) ? op->imm
+                                                    : block->end_address;
+  return op - begin + 1;
+blt:
+  next_pc = static_cast<int32_t>(ReadXreg(op->rs1)) <
+                    static_cast<int32_t>(ReadXreg(op->rs2))
+                ? op->imm
+                : block->end_address;
+  return op - begin + 1;
+bltu:
+  next_pc = ReadXreg(op->rs1) < ReadXreg(op->rs2) ? op->imm
+                                                   : block->end_address;
+  return op - begin + 1;
+bne:
+  next_pc = ReadXreg(op->rs1) != ReadXreg(op->rs2) ? op->imm
+                                                    : block->end_address;
+  return op - begin + 1;
+jal:
+  WriteXreg(op->rd, block->end_address);
+  next_pc = op->imm;
+  return op - begin + 1;
+jalr:
+  // Read the base register before writing the link register, as they may be
+  // the same.
+  next_pc = ReadXreg(op->rs1) + op->imm;
+  WriteXreg(op->rd, block->end_address);
+  return op - begin + 1;
+
+generic:
+  op->inst->Execute(nullptr);
+  if (pc_->data_buffer() != pc_db) {
+    // The instruction updated the pc.
+    next_pc = pc_->data_buffer()->Get<uint32_t>(0);
+    return op - begin + 1;
+  }
+  if (halted.load(std::memory_order_relaxed)) {
+    next_pc = op->inst->address() + op->inst->size();
+    return op - begin + 1;
+  }
+  DISPATCH_NEXT();
+
+end:
+  next_pc = block->end_address;
+  return op - begin;
+
+#undef DISPATCH_NEXT
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_THREADED_INTERPRETER_H_
+#define MPACT_SIM_CODELABS_OTHER_THREADED_INTERPRETER_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+#include "other/basic_block_cache.h"
+#include "other/riscv_register.h"
+#include "other/riscv_simple_state.h"
+#include "riscv_isa_decoder/solution/riscv32i_enums.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// The threaded interpreter executes basic blocks by lowering them into an
+// array of threaded operations, each of which holds the address of its handler
+// along with pre-extracted register indices and immediates. The handlers are
+// dispatched using computed goto (a GNU extension supported by both gcc and
+// clang). The alu, branch and jump instructions are implemented directly in
+// the handlers, bypassing the semantic functions and operand interfaces. All
+// other instructions fall back to Instruction::Execute.
+class ThreadedInterpreter {
+ public:
+  // The memory interface is used to read instruction words when lowering
+  // blocks, so it should bypass any semihosting or watch points.
+  ThreadedInterpreter(riscv::RiscVState *state, util::MemoryInterface *memory);
+  ~ThreadedInterpreter();
+
+  // Executes the block, lowering it first if needed. Execution stops early if
+  // halted is true after an instruction that falls back to the generic path.
+  // Returns the number of instructions executed, and sets next_pc to the
+  // address of the next instruction to execute.
+  int ExecuteBlock(BasicBlock *block, const std::atomic<bool> &halted,
+                   uint32_t &next_pc);
+
+ private:
+  // Generates the threaded code for the block.
+  void Lower(BasicBlock *block);
+  // Implements ExecuteBlock. If block is nullptr, it just initializes the
+  // handler table.
+  int Execute(BasicBlock *block, const std::atomic<bool> &halted,
+              uint32_t &next_pc);
+
+  uint32_t ReadXreg(int num) const { return *xreg_values_[num]; }
+  void WriteXreg(int num, uint32_t value) {
+    if (num == 0) return;
+    *xreg_values_[num] = value;
+  }
+
+  riscv::RiscVState *state_;
+  util::MemoryInterface *memory_;
+  generic::DataBuffer *inst_db_;
+  riscv::RV32Register *pc_;
+  // Pointers to the integer register values, owned by the state.
+  uint32_t *xreg_values_[32];
+  // Handler addresses, indexed by opcode.
+  const void *handlers_[static_cast<int>(OpcodeEnum::kPastMaxValue)];
+  const void *generic_handler_ = nullptr;
+  const void *nop_handler_ = nullptr;
+  const void *end_handler_ = nullptr;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_THREADED_INTERPRETER_H_
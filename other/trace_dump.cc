@@ -0,0 +1,95 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Converts a binary instruction trace written by rv32i_sim --trace_file to
+// text. Each record is printed on its own line as:
+//
+//   <stream> <pc> <instruction word> [x<n>=<value>] [@<memory address>]
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_format.h"
+#include "other/trace_format.h"
+#include "other/trace_reader.h"
+
+using ::mpact::sim::codelab::kTraceMemAddress;
+using ::mpact::sim::codelab::kTraceRegWrite;
+using ::mpact::sim::codelab::kTraceWord;
+using ::mpact::sim::codelab::TraceChunkHeader;
+using ::mpact::sim::codelab::TraceDecoder;
+using ::mpact::sim::codelab::TraceReader;
+using ::mpact::sim::codelab::TraceRecord;
+
+// Decoding state of a stream. Instruction words are only recorded the first
+// time an instruction is traced, so they are remembered by address.
+struct StreamState {
+  TraceDecoder decoder;
+  absl::flat_hash_map<uint32_t, uint32_t> words;
+};
+
+int main(int argc, char **argv) {
+  auto arg_vec = absl::ParseCommandLine(argc, argv);
+  if (arg_vec.size() != 2) {
+    std::cerr << "Usage: trace_dump <trace file>" << std::endl;
+    return -1;
+  }
+  auto res = TraceReader::Open(arg_vec[1]);
+  if (!res.ok()) {
+    std::cerr << res.status().message() << std::endl;
+    return -1;
+  }
+  std::unique_ptr<TraceReader> reader(res.value());
+
+  absl::flat_hash_map<uint32_t, StreamState> streams;
+  TraceChunkHeader header;
+  const uint8_t *data;
+  TraceRecord record;
+  while (true) {
+    auto chunk = reader->NextChunk(header, data);
+    if (!chunk.ok()) {
+      std::cerr << chunk.status().message() << std::endl;
+      return -1;
+    }
+    if (!chunk.value()) break;
+    auto &stream = streams[header.stream_id];
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + header.size;
+    while (ptr != end) {
+      ptr = stream.decoder.Decode(ptr, end, record);
+      if (ptr == nullptr) {
+        std::cerr << "Malformed trace record" << std::endl;
+        return -1;
+      }
+      uint32_t &word = stream.words[record.pc];
+      if (record.flags & kTraceWord) word = record.word;
+      std::string line =
+          absl::StrFormat("%u %08x %08x", header.stream_id, record.pc, word);
+      if (record.flags & kTraceRegWrite) {
+        absl::StrAppendFormat(&line, " x%d=%08x", record.rd, record.rd_value);
+      }
+      if (record.flags & kTraceMemAddress) {
+        absl::StrAppendFormat(&line, " @%08x", record.mem_address);
+      }
+      line.push_back('\n');
+      std::fwrite(line.data(), 1, line.size(), stdout);
+    }
+  }
+  return 0;
+}
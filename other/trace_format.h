@@ -0,0 +1,198 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_TRACE_FORMAT_H_
+#define MPACT_SIM_CODELABS_OTHER_TRACE_FORMAT_H_
+
+#include <cstdint>
+#include <cstring>
+
+// This file defines the binary format of instruction traces.
+//
+// A trace file starts with the 8 byte magic kTraceMagic, followed by a
+// sequence of chunks. Each chunk has an 8 byte header, holding the 32 bit
+// stream id and the 32 bit size of the chunk data, followed by the chunk data,
+// which is a sequence of complete trace records. A trace may contain several
+// streams (e.g., one per core), whose chunks are interleaved in the file. Each
+// stream is encoded independently.
+//
+// A trace record starts with a flags byte, followed by the fields indicated by
+// the flags, in this order:
+//   kTracePcDelta:     zigzag varint of pc - expected pc, where the expected
+//                      pc is the previous pc + 4.
+//   kTraceWord:        32 bit instruction word. It's only recorded the first
+//                      time an instruction is traced.
+//   kTraceRegWrite:    8 bit register number, followed by the zigzag varint of
+//                      the value minus the previous value traced for that
+//                      register.
+//   kTraceMemAddress:  zigzag varint of the address minus the previous memory
+//                      address traced.
+// All multi-byte fixed size values are in host byte order. At the start of a
+// stream the expected pc, the register values, and the memory address are 0.
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+inline constexpr char kTraceMagic[8] = {'R', 'V', '3', '2', 'T', 'R', 'C',
+                                        '1'};
+
+// Record flags.
+enum TraceFlags : uint8_t {
+  kTracePcDelta = 1 << 0,
+  kTraceWord = 1 << 1,
+  kTraceRegWrite = 1 << 2,
+  kTraceMemAddress = 1 << 3,
+};
+
+// Maximum encoded size of a record: flags, three 32 bit varints, the word and
+// the register number.
+inline constexpr int kTraceMaxRecordSize = 1 + 3 * 5 + 4 + 1;
+
+struct TraceChunkHeader {
+  uint32_t stream_id;
+  uint32_t size;
+};
+
+// Decoded trace record. The flags indicate which fields are valid, except for
+// kTracePcDelta, as the pc is always valid.
+struct TraceRecord {
+  uint8_t flags = 0;
+  uint32_t pc = 0;
+  uint32_t word = 0;
+  uint8_t rd = 0;
+  uint32_t rd_value = 0;
+  uint32_t mem_address = 0;
+};
+
+inline uint32_t ZigZagEncode(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t ZigZagDecode(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+inline uint8_t *EncodeVarint(uint32_t value, uint8_t *ptr) {
+  while (value >= 0x80) {
+    *ptr++ = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  *ptr++ = static_cast<uint8_t>(value);
+  return ptr;
+}
+
+// Returns nullptr if the varint is truncated or too long.
+inline const uint8_t *DecodeVarint(const uint8_t *ptr, const uint8_t *end,
+                                   uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (ptr == end) return nullptr;
+    uint8_t byte = *ptr++;
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return ptr;
+  }
+  return nullptr;
+}
+
+// Holds the delta encoding state of a stream, and encodes records.
+class TraceEncoder {
+ public:
+  // Encodes the record at ptr, which must have room for kTraceMaxRecordSize
+  // bytes, and returns the pointer past the record. The kTracePcDelta flag is
+  // computed by the encoder.
+  uint8_t *Encode(const TraceRecord &record, uint8_t *ptr) {
+    uint8_t *flags = ptr++;
+    *flags = record.flags & ~kTracePcDelta;
+    if (record.pc != expected_pc_) {
+      *flags |= kTracePcDelta;
+      int32_t delta = record.pc - expected_pc_;
+      ptr = EncodeVarint(ZigZagEncode(delta), ptr);
+    }
+    expected_pc_ = record.pc + 4;
+    if (record.flags & kTraceWord) {
+      std::memcpy(ptr, &record.word, sizeof(record.word));
+      ptr += sizeof(record.word);
+    }
+    if (record.flags & kTraceRegWrite) {
+      *ptr++ = record.rd;
+      uint32_t &previous = registers_[record.rd & 31];
+      int32_t delta = record.rd_value - previous;
+      ptr = EncodeVarint(ZigZagEncode(delta), ptr);
+      previous = record.rd_value;
+    }
+    if (record.flags & kTraceMemAddress) {
+      int32_t delta = record.mem_address - mem_address_;
+      ptr = EncodeVarint(ZigZagEncode(delta), ptr);
+      mem_address_ = record.mem_address;
+    }
+    return ptr;
+  }
+
+ private:
+  uint32_t expected_pc_ = 0;
+  uint32_t registers_[32] = {};
+  uint32_t mem_address_ = 0;
+};
+
+// Holds the delta decoding state of a stream, and decodes records.
+class TraceDecoder {
+ public:
+  // Decodes the record at ptr, and returns the pointer past the record, or
+  // nullptr if the record is malformed or extends past end.
+  const uint8_t *Decode(const uint8_t *ptr, const uint8_t *end,
+                        TraceRecord &record) {
+    if (ptr == end) return nullptr;
+    record.flags = *ptr++;
+    uint32_t value;
+    record.pc = expected_pc_;
+    if (record.flags & kTracePcDelta) {
+      if ((ptr = DecodeVarint(ptr, end, value)) == nullptr) return nullptr;
+      record.pc += ZigZagDecode(value);
+    }
+    expected_pc_ = record.pc + 4;
+    if (record.flags & kTraceWord) {
+      if (end - ptr < static_cast<int>(sizeof(record.word))) return nullptr;
+      std::memcpy(&record.word, ptr, sizeof(record.word));
+      ptr += sizeof(record.word);
+    }
+    if (record.flags & kTraceRegWrite) {
+      if (ptr == end) return nullptr;
+      record.rd = *ptr++ & 31;
+      if ((ptr = DecodeVarint(ptr, end, value)) == nullptr) return nullptr;
+      registers_[record.rd] += ZigZagDecode(value);
+      record.rd_value = registers_[record.rd];
+    }
+    if (record.flags & kTraceMemAddress) {
+      if ((ptr = DecodeVarint(ptr, end, value)) == nullptr) return nullptr;
+      mem_address_ += ZigZagDecode(value);
+      record.mem_address = mem_address_;
+    }
+    return ptr;
+  }
+
+ private:
+  uint32_t expected_pc_ = 0;
+  uint32_t registers_[32] = {};
+  uint32_t mem_address_ = 0;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_TRACE_FORMAT_H_
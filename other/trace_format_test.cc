@@ -0,0 +1,200 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/trace_format.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "other/trace_reader.h"
+#include "other/trace_writer.h"
+
+namespace {
+
+using ::mpact::sim::codelab::kTraceMaxRecordSize;
+using ::mpact::sim::codelab::kTraceMemAddress;
+using ::mpact::sim::codelab::kTracePcDelta;
+using ::mpact::sim::codelab::kTraceRegWrite;
+using ::mpact::sim::codelab::kTraceWord;
+using ::mpact::sim::codelab::TraceChunkHeader;
+using ::mpact::sim::codelab::TraceDecoder;
+using ::mpact::sim::codelab::TraceEncoder;
+using ::mpact::sim::codelab::TraceReader;
+using ::mpact::sim::codelab::TraceRecord;
+using ::mpact::sim::codelab::TraceStream;
+using ::mpact::sim::codelab::TraceWriter;
+
+TraceRecord MakeRecord(uint8_t flags, uint32_t pc, uint32_t word, uint8_t rd,
+                       uint32_t rd_value, uint32_t mem_address) {
+  TraceRecord record;
+  record.flags = flags;
+  record.pc = pc;
+  record.word = word;
+  record.rd = rd;
+  record.rd_value = rd_value;
+  record.mem_address = mem_address;
+  return record;
+}
+
+// Compares the fields that the flags of the expected record mark as valid.
+void ExpectSameRecord(const TraceRecord &expected, const TraceRecord &actual) {
+  EXPECT_EQ(actual.flags & ~kTracePcDelta, expected.flags);
+  EXPECT_EQ(actual.pc, expected.pc);
+  if (expected.flags & kTraceWord) EXPECT_EQ(actual.word, expected.word);
+  if (expected.flags & kTraceRegWrite) {
+    EXPECT_EQ(actual.rd, expected.rd);
+    EXPECT_EQ(actual.rd_value, expected.rd_value);
+  }
+  if (expected.flags & kTraceMemAddress) {
+    EXPECT_EQ(actual.mem_address, expected.mem_address);
+  }
+}
+
+// Returns the records of a loop that is executed twice: a load, an add, a
+// store, and a backward branch. The instruction words are only recorded the
+// first time around.
+std::vector<TraceRecord> MakeLoopRecords(uint32_t base) {
+  std::vector<TraceRecord> records;
+  for (int i = 0; i < 2; i++) {
+    uint8_t word = i == 0 ? kTraceWord : 0;
+    // Load whose address is below the previous store address.
+    records.push_back(MakeRecord(word | kTraceRegWrite | kTraceMemAddress,
+                                 base, 0x0005'2283, 5, 0xffff'fff0 + i,
+                                 0x8000'1000 - 0x100 * i));
+    // Register value that decreases, and one that wraps around.
+    records.push_back(MakeRecord(word | kTraceRegWrite, base + 4, 0x0012'8293,
+                                 5, i == 0 ? 0x7fff'ffff : 0x8000'0001, 0));
+    records.push_back(MakeRecord(word | kTraceMemAddress, base + 8,
+                                 0x0055'2023, 0, 0, 0x8000'0ff0 - 0x100 * i));
+    records.push_back(MakeRecord(word, base + 12, 0xfe00'1ae3, 0, 0, 0));
+  }
+  // Jump far forward after the loop.
+  records.push_back(MakeRecord(kTraceWord | kTraceRegWrite, base + 0x10'0000,
+                               0x0000'006f, 1, base + 16, 0));
+  return records;
+}
+
+TEST(TraceFormatTest, EncodeDecodeRoundTrip) {
+  std::vector<TraceRecord> records = MakeLoopRecords(0x1'0000);
+  TraceEncoder encoder;
+  std::vector<uint8_t> buffer(records.size() * kTraceMaxRecordSize);
+  uint8_t *ptr = buffer.data();
+  std::vector<uint8_t *> ends;
+  for (auto const &record : records) {
+    ptr = encoder.Encode(record, ptr);
+    ends.push_back(ptr);
+  }
+  const uint8_t *end = ptr;
+  TraceDecoder decoder;
+  const uint8_t *cursor = buffer.data();
+  for (size_t i = 0; i < records.size(); i++) {
+    TraceRecord record;
+    const uint8_t *start = cursor;
+    cursor = decoder.Decode(cursor, end, record);
+    ASSERT_NE(cursor, nullptr) << "record " << i;
+    EXPECT_EQ(cursor, ends[i]) << "record " << i;
+    ExpectSameRecord(records[i], record);
+    // The pc delta is only encoded when the pc isn't the previous pc + 4, so
+    // only the loop entry, the backward branch target, and the jump target
+    // have one.
+    bool sequential = (i > 0) && (records[i].pc == records[i - 1].pc + 4);
+    EXPECT_EQ((*start & kTracePcDelta) != 0, !sequential) << "record " << i;
+  }
+  EXPECT_EQ(cursor, end);
+}
+
+TEST(TraceFormatTest, SequentialRecordIsOneByte) {
+  TraceEncoder encoder;
+  uint8_t buffer[2 * kTraceMaxRecordSize];
+  uint8_t *ptr = encoder.Encode(MakeRecord(kTraceWord, 0, 0x13, 0, 0, 0),
+                                buffer);
+  EXPECT_EQ(ptr - buffer, 1 + 4);
+  uint8_t *next = encoder.Encode(MakeRecord(0, 4, 0, 0, 0, 0), ptr);
+  EXPECT_EQ(next - ptr, 1);
+}
+
+TEST(TraceFormatTest, TruncatedRecordIsRejected) {
+  TraceEncoder encoder;
+  uint8_t buffer[kTraceMaxRecordSize];
+  uint8_t *end = encoder.Encode(
+      MakeRecord(kTraceWord | kTraceRegWrite | kTraceMemAddress, 0x1234,
+                 0x0005'2283, 5, 0x1234'5678, 0x8765'4321),
+      buffer);
+  for (const uint8_t *short_end = buffer; short_end < end; short_end++) {
+    TraceDecoder decoder;
+    TraceRecord record;
+    EXPECT_EQ(decoder.Decode(buffer, short_end, record), nullptr);
+  }
+}
+
+// Writes enough records to two interleaved streams to span several chunks of
+// each, and reads them back, decoding each stream independently.
+TEST(TraceFormatTest, WriterReaderRoundTrip) {
+  std::string file_name = testing::TempDir() + "/trace_format_test.trace";
+  auto writer_result = TraceWriter::Create(file_name);
+  ASSERT_TRUE(writer_result.ok());
+  TraceWriter *writer = writer_result.value();
+  TraceStream *streams[2] = {writer->AddStream(), writer->AddStream()};
+  std::vector<TraceRecord> loops[2] = {MakeLoopRecords(0x1'0000),
+                                       MakeLoopRecords(0x2'0000)};
+  // Each loop encodes to a few dozen bytes, so this fills many chunks.
+  int num_iterations = 4 * TraceStream::kChunkSize / 16;
+  for (int i = 0; i < num_iterations; i++) {
+    for (int s = 0; s < 2; s++) {
+      // Write the streams at different rates to vary the interleaving.
+      if ((s == 1) && (i % 3 == 0)) continue;
+      for (auto const &record : loops[s]) streams[s]->Append(record);
+    }
+  }
+  ASSERT_TRUE(writer->Close().ok());
+  delete writer;
+
+  auto reader_result = TraceReader::Open(file_name);
+  ASSERT_TRUE(reader_result.ok());
+  TraceReader *reader = reader_result.value();
+  TraceDecoder decoders[2];
+  size_t positions[2] = {0, 0};
+  int num_chunks[2] = {0, 0};
+  TraceChunkHeader header;
+  const uint8_t *data;
+  while (true) {
+    auto next = reader->NextChunk(header, data);
+    ASSERT_TRUE(next.ok());
+    if (!next.value()) break;
+    ASSERT_LT(header.stream_id, 2u);
+    EXPECT_LE(header.size, TraceStream::kChunkSize);
+    int s = header.stream_id;
+    num_chunks[s]++;
+    // A chunk only holds complete records.
+    const uint8_t *end = data + header.size;
+    while (data != end) {
+      TraceRecord record;
+      data = decoders[s].Decode(data, end, record);
+      ASSERT_NE(data, nullptr);
+      auto const &loop = loops[s];
+      ExpectSameRecord(loop[positions[s] % loop.size()], record);
+      positions[s]++;
+    }
+  }
+  delete reader;
+  int stream1_iterations = num_iterations - (num_iterations + 2) / 3;
+  EXPECT_EQ(positions[0], num_iterations * loops[0].size());
+  EXPECT_EQ(positions[1], stream1_iterations * loops[1].size());
+  EXPECT_GT(num_chunks[0], 1);
+  EXPECT_GT(num_chunks[1], 1);
+}
+
+}  // namespace
@@ -0,0 +1,96 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/trace_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "other/trace_format.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+absl::StatusOr<TraceReader *> TraceReader::Open(const std::string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("Unable to open trace file '", file_name, "'"));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return absl::InternalError(
+        absl::StrCat("Unable to stat trace file '", file_name, "'"));
+  }
+  size_t size = file_stat.st_size;
+  if (size < sizeof(kTraceMagic)) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        absl::StrCat("'", file_name, "' is not a trace file"));
+  }
+  void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping remains valid after the file is closed.
+  close(fd);
+  if (base == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrCat("Unable to map trace file '", file_name, "'"));
+  }
+  if (std::memcmp(base, kTraceMagic, sizeof(kTraceMagic)) != 0) {
+    munmap(base, size);
+    return absl::InvalidArgumentError(
+        absl::StrCat("'", file_name, "' is not a trace file"));
+  }
+  // The trace is read front to back.
+  (void)madvise(base, size, MADV_SEQUENTIAL);
+  return new TraceReader(static_cast<const uint8_t *>(base), size);
+}
+
+TraceReader::TraceReader(const uint8_t *base, size_t size)
+    : base_(base), size_(size), offset_(sizeof(kTraceMagic)) {}
+
+TraceReader::~TraceReader() {
+  munmap(const_cast<uint8_t *>(base_), size_);
+}
+
+absl::StatusOr<bool> TraceReader::NextChunk(TraceChunkHeader &header,
+                                            const uint8_t *&data) {
+  if (offset_ == size_) return false;
+  if (size_ - offset_ < sizeof(header)) {
+    return absl::DataLossError("Truncated trace chunk header");
+  }
+  std::memcpy(&header, base_ + offset_, sizeof(header));
+  offset_ += sizeof(header);
+  if (size_ - offset_ < header.size) {
+    return absl::DataLossError("Truncated trace chunk");
+  }
+  data = base_ + offset_;
+  offset_ += header.size;
+  return true;
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_TRACE_READER_H_
+#define MPACT_SIM_CODELABS_OTHER_TRACE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "other/trace_format.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Provides sequential access to the chunks of a trace file, which is memory
+// mapped, so that the chunk data is read directly from the page cache.
+class TraceReader {
+ public:
+  static absl::StatusOr<TraceReader *> Open(const std::string &file_name);
+  ~TraceReader();
+
+  // Gets the next chunk. Returns false at the end of the trace, and an error
+  // if the trace is truncated.
+  absl::StatusOr<bool> NextChunk(TraceChunkHeader &header,
+                                 const uint8_t *&data);
+  // Restarts from the first chunk.
+  void Rewind() { offset_ = sizeof(kTraceMagic); }
+
+ private:
+  TraceReader(const uint8_t *base, size_t size);
+
+  const uint8_t *base_;
+  size_t size_;
+  size_t offset_;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_TRACE_READER_H_
@@ -0,0 +1,93 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/trace_replay.h"
+
+#include <cstdint>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "other/trace_format.h"
+#include "other/trace_reader.h"
+#include "riscv_bin_decoder/solution/riscv32i_bin_decoder.h"
+#include "riscv_isa_decoder/solution/riscv32i_enums.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+TraceReplay::TraceReplay(std::string name)
+    : Component(name), counter_num_instructions_("num_instructions", 0) {
+  for (int i = 0; i < static_cast<int>(OpcodeEnum::kPastMaxValue); i++) {
+    counter_opcode_[i].Initialize(absl::StrCat("num_", kOpcodeNames[i]), 0);
+    CHECK_OK(AddCounter(&counter_opcode_[i]));
+  }
+  CHECK_OK(AddCounter(&counter_num_instructions_))
+      << "Failed to register counter";
+}
+
+absl::Status TraceReplay::Replay(TraceReader *reader) {
+  reader->Rewind();
+  absl::flat_hash_map<uint32_t, StreamState> streams;
+  uint64_t opcode_counts[static_cast<int>(OpcodeEnum::kPastMaxValue)] = {};
+  uint64_t num_instructions = 0;
+  TraceChunkHeader header;
+  const uint8_t *data;
+  TraceRecord record;
+  absl::Status status;
+  while (true) {
+    auto result = reader->NextChunk(header, data);
+    if (!result.ok()) {
+      status = result.status();
+      break;
+    }
+    if (!result.value()) break;
+    auto &stream = streams[header.stream_id];
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + header.size;
+    while (ptr != end) {
+      ptr = stream.decoder.Decode(ptr, end, record);
+      if (ptr == nullptr) break;
+      auto &[word, opcode] = stream.instructions[record.pc];
+      if (record.flags & kTraceWord) {
+        word = record.word;
+        opcode = DecodeRiscVInst32(word);
+      }
+      record.word = word;
+      opcode_counts[static_cast<int>(opcode)]++;
+      num_instructions++;
+      for (auto *observer : observers_) {
+        observer->Observe(header.stream_id, opcode, record);
+      }
+    }
+    if (ptr == nullptr) {
+      status = absl::DataLossError("Malformed trace record");
+      break;
+    }
+  }
+  // Update the counters even if the trace is malformed, so that they reflect
+  // the part of the trace that was replayed.
+  for (int i = 0; i < static_cast<int>(OpcodeEnum::kPastMaxValue); i++) {
+    if (opcode_counts[i] > 0) counter_opcode_[i].Increment(opcode_counts[i]);
+  }
+  counter_num_instructions_.Increment(num_instructions);
+  return status;
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_TRACE_REPLAY_H_
+#define MPACT_SIM_CODELABS_OTHER_TRACE_REPLAY_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "mpact/sim/generic/component.h"
+#include "mpact/sim/generic/counters.h"
+#include "other/trace_format.h"
+#include "other/trace_reader.h"
+#include "riscv_isa_decoder/solution/riscv32i_enums.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+// Interface for analyses (e.g., cache, branch predictor, or working set
+// models) that are driven by replaying a trace.
+class TraceObserver {
+ public:
+  virtual ~TraceObserver() = default;
+  // Called for each instruction in the trace, in order within each stream.
+  // The instruction word in the record is always valid.
+  virtual void Observe(uint32_t stream_id, OpcodeEnum opcode,
+                       const TraceRecord &record) = 0;
+};
+
+// Replays a trace recorded by RV32ITop, without decoding instructions into
+// instruction objects or executing any semantic functions. The replay updates
+// the same counters as RV32ITop, and calls any observers for each instruction.
+// Analysis parameters can then be explored by replaying the trace repeatedly,
+// instead of re-simulating the program.
+class TraceReplay : public generic::Component {
+ public:
+  explicit TraceReplay(std::string name);
+
+  // The observers are not owned by the replay.
+  void AddObserver(TraceObserver *observer) { observers_.push_back(observer); }
+  // Replays the trace from the start.
+  absl::Status Replay(TraceReader *reader);
+
+ private:
+  // Decoding state of a stream. Instruction words are only recorded the first
+  // time an instruction is traced, so they, and the opcodes, are remembered
+  // by address.
+  struct StreamState {
+    TraceDecoder decoder;
+    absl::flat_hash_map<uint32_t, std::pair<uint32_t, OpcodeEnum>>
+        instructions;
+  };
+
+  std::vector<TraceObserver *> observers_;
+  // Counters, with the same names as in RV32ITop.
+  generic::SimpleCounter<uint64_t>
+      counter_opcode_[static_cast<int>(OpcodeEnum::kPastMaxValue)];
+  generic::SimpleCounter<uint64_t> counter_num_instructions_;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_TRACE_REPLAY_H_
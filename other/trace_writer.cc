@@ -0,0 +1,146 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/trace_writer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT: third_party code.
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "other/trace_format.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+TraceStream::TraceStream(TraceWriter *writer, uint32_t id)
+    : writer_(writer), id_(id) {
+  for (int i = 0; i < kNumChunks; i++) {
+    auto *chunk = new Chunk;
+    chunk->stream = this;
+    chunk->data = std::make_unique<uint8_t[]>(kChunkSize);
+    chunks_.push_back(chunk);
+  }
+  chunk_ = chunks_[0];
+  cursor_ = chunk_->data.get();
+  limit_ = cursor_ + kChunkSize;
+  free_chunks_.assign(chunks_.begin() + 1, chunks_.end());
+}
+
+TraceStream::~TraceStream() {
+  for (auto *chunk : chunks_) delete chunk;
+}
+
+void TraceStream::Flush() {
+  if (cursor_ == chunk_->data.get()) return;
+  NextChunk();
+}
+
+void TraceStream::NextChunk() {
+  chunk_->size = cursor_ - chunk_->data.get();
+  writer_->Submit(chunk_);
+  chunk_ = writer_->GetFreeChunk(this);
+  cursor_ = chunk_->data.get();
+  limit_ = cursor_ + kChunkSize;
+}
+
+absl::StatusOr<TraceWriter *> TraceWriter::Create(
+    const std::string &file_name) {
+  std::FILE *file = std::fopen(file_name.c_str(), "wb");
+  if (file == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("Unable to open trace file '", file_name, "'"));
+  }
+  if (std::fwrite(kTraceMagic, sizeof(kTraceMagic), 1, file) != 1) {
+    std::fclose(file);
+    return absl::InternalError(
+        absl::StrCat("Unable to write trace file '", file_name, "'"));
+  }
+  return new TraceWriter(file);
+}
+
+TraceWriter::TraceWriter(std::FILE *file) : file_(file) {
+  thread_ = std::thread([this]() { WriteChunks(); });
+}
+
+TraceWriter::~TraceWriter() {
+  (void)Close();
+  for (auto *stream : streams_) delete stream;
+}
+
+TraceStream *TraceWriter::AddStream() {
+  absl::MutexLock lock(&mutex_);
+  auto *stream = new TraceStream(this, streams_.size());
+  streams_.push_back(stream);
+  return stream;
+}
+
+absl::Status TraceWriter::Close() {
+  if (file_ == nullptr) return absl::OkStatus();
+  for (auto *stream : streams_) stream->Flush();
+  {
+    absl::MutexLock lock(&mutex_);
+    closing_ = true;
+  }
+  thread_.join();
+  bool failed = (std::fclose(file_) != 0) || write_failed_;
+  file_ = nullptr;
+  if (failed) return absl::InternalError("Failed to write trace file");
+  return absl::OkStatus();
+}
+
+void TraceWriter::Submit(TraceStream::Chunk *chunk) {
+  absl::MutexLock lock(&mutex_);
+  queue_.push_back(chunk);
+}
+
+TraceStream::Chunk *TraceWriter::GetFreeChunk(TraceStream *stream) {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(stream, &TraceStream::HasFreeChunk));
+  auto *chunk = stream->free_chunks_.back();
+  stream->free_chunks_.pop_back();
+  return chunk;
+}
+
+void TraceWriter::WriteChunks() {
+  while (true) {
+    TraceStream::Chunk *chunk;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &TraceWriter::HasWork));
+      // Only exit once all the queued chunks have been written.
+      if (queue_.empty()) return;
+      chunk = queue_.front();
+      queue_.pop_front();
+    }
+    TraceChunkHeader header = {chunk->stream->id(), chunk->size};
+    bool ok = (std::fwrite(&header, sizeof(header), 1, file_) == 1) &&
+              (std::fwrite(chunk->data.get(), 1, chunk->size, file_) ==
+               chunk->size);
+    absl::MutexLock lock(&mutex_);
+    write_failed_ |= !ok;
+    chunk->size = 0;
+    chunk->stream->free_chunks_.push_back(chunk);
+  }
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_TRACE_WRITER_H_
+#define MPACT_SIM_CODELABS_OTHER_TRACE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT: third_party code.
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "other/trace_format.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+class TraceWriter;
+
+// A stream of trace records produced by a single thread. The records are
+// encoded into fixed size chunks taken from a small ring owned by the stream.
+// Full chunks are handed to the background thread of the trace writer, which
+// writes them to the file and then returns them to the ring. Appending a
+// record never performs I/O, and only waits if the writer has fallen behind by
+// the whole ring.
+class TraceStream {
+ public:
+  static constexpr size_t kChunkSize = 256 * 1024;
+  static constexpr int kNumChunks = 8;
+
+  // Appends a record to the stream.
+  void Append(const TraceRecord &record) {
+    if (limit_ - cursor_ < kTraceMaxRecordSize) NextChunk();
+    cursor_ = encoder_.Encode(record, cursor_);
+  }
+  // Hands the records appended so far to the writer.
+  void Flush();
+
+  uint32_t id() const { return id_; }
+
+ private:
+  friend class TraceWriter;
+
+  struct Chunk {
+    TraceStream *stream;
+    uint32_t size = 0;
+    std::unique_ptr<uint8_t[]> data;
+  };
+
+  TraceStream(TraceWriter *writer, uint32_t id);
+  ~TraceStream();
+
+  // Submits the current chunk, and waits for a free one.
+  void NextChunk();
+  bool HasFreeChunk() const { return !free_chunks_.empty(); }
+
+  TraceWriter *writer_;
+  uint32_t id_;
+  TraceEncoder encoder_;
+  Chunk *chunk_ = nullptr;
+  uint8_t *cursor_ = nullptr;
+  uint8_t *limit_ = nullptr;
+  // All the chunks of the stream.
+  std::vector<Chunk *> chunks_;
+  // Chunks that are ready for use. Guarded by the writer mutex.
+  std::vector<Chunk *> free_chunks_;
+};
+
+// The trace writer owns the trace file, the streams writing to it, and the
+// background thread that writes the chunks of all the streams to the file.
+// See trace_format.h for the file format.
+class TraceWriter {
+ public:
+  static absl::StatusOr<TraceWriter *> Create(const std::string &file_name);
+  ~TraceWriter();
+
+  // Adds a new stream to the trace. The stream is owned by the writer.
+  TraceStream *AddStream();
+  // Flushes all the streams, waits until all the data has been written, and
+  // closes the file. No thread may be appending to any of the streams. The
+  // streams must not be used afterwards.
+  absl::Status Close();
+
+ private:
+  explicit TraceWriter(std::FILE *file);
+
+  // Queues the chunk to be written.
+  void Submit(TraceStream::Chunk *chunk);
+  // Waits for, and returns, a free chunk of the stream.
+  TraceStream::Chunk *GetFreeChunk(TraceStream *stream);
+  // Body of the background thread.
+  void WriteChunks();
+  bool HasWork() const { return !queue_.empty() || closing_; }
+
+  friend class TraceStream;
+
+  std::FILE *file_;
+  std::thread thread_;
+  absl::Mutex mutex_;
+  std::deque<TraceStream::Chunk *> queue_;
+  bool closing_ = false;
+  bool write_failed_ = false;
+  std::vector<TraceStream *> streams_;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_TRACE_WRITER_H_
@@ -0,0 +1,225 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/watchpoint_memory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+WatchpointMemory::WatchpointMemory(util::MemoryInterface *memory,
+                                   HitCallback on_hit)
+    : memory_(memory),
+      on_hit_(std::move(on_hit)),
+      watched_pages_(kNumPages / 64, 0) {}
+
+void WatchpointMemory::Load(uint64_t address, DataBuffer *db,
+                            Instruction *inst, ReferenceCount *context) {
+  memory_->Load(address, db, inst, context);
+  if (IsWatched(address) && HitsLoad(address, db->size<uint8_t>())) {
+    on_hit_(address);
+  }
+}
+
+void WatchpointMemory::Load(DataBuffer *address_db, DataBuffer *mask_db,
+                            int el_size, DataBuffer *db, Instruction *inst,
+                            ReferenceCount *context) {
+  memory_->Load(address_db, mask_db, el_size, db, inst, context);
+  for (unsigned i = 0; i < address_db->size<uint64_t>(); i++) {
+    uint64_t address = address_db->Get<uint64_t>(i);
+    if (!mask_db->Get<bool>(i) || !IsWatched(address)) continue;
+    if (HitsLoad(address, el_size)) {
+      on_hit_(address);
+      return;
+    }
+  }
+}
+
+void WatchpointMemory::Store(uint64_t address, DataBuffer *db) {
+  if (!IsWatched(address)) {
+    memory_->Store(address, db);
+    return;
+  }
+  bool hit = HitsStore(address, db);
+  memory_->Store(address, db);
+  if (hit) on_hit_(address);
+}
+
+void WatchpointMemory::Store(DataBuffer *address_db, DataBuffer *mask_db,
+                             int el_size, DataBuffer *db) {
+  // Value changes aren't detected for masked stores, so they are reported as
+  // plain writes.
+  for (unsigned i = 0; i < address_db->size<uint64_t>(); i++) {
+    uint64_t address = address_db->Get<uint64_t>(i);
+    if (!mask_db->Get<bool>(i) || !IsWatched(address)) continue;
+    bool hit = false;
+    ForEachOverlap(address, el_size,
+                   [&hit](const Watchpoint &watchpoint) {
+                     hit |= watchpoint.type != WatchType::kRead;
+                   });
+    if (hit) {
+      memory_->Store(address_db, mask_db, el_size, db);
+      on_hit_(address);
+      return;
+    }
+  }
+  memory_->Store(address_db, mask_db, el_size, db);
+}
+
+absl::Status WatchpointMemory::SetWatchpoint(uint64_t address,
+                                             uint64_t length,
+                                             WatchType type) {
+  if (length == 0) {
+    return absl::InvalidArgumentError("Watchpoint length must be > 0");
+  }
+  if (address + length < address) {
+    return absl::InvalidArgumentError("Watchpoint range wraps around");
+  }
+  Watchpoint watchpoint = {address, address + length, type};
+  if (!watchpoints_.try_emplace(address, watchpoint).second) {
+    return absl::AlreadyExistsError(
+        absl::StrCat("Watchpoint already set at 0x", absl::Hex(address)));
+  }
+  AddToPages(watchpoint);
+  return absl::OkStatus();
+}
+
+absl::Status WatchpointMemory::ClearWatchpoint(uint64_t address) {
+  auto iter = watchpoints_.find(address);
+  if (iter == watchpoints_.end()) {
+    return absl::NotFoundError(
+        absl::StrCat("No watchpoint set at 0x", absl::Hex(address)));
+  }
+  RemoveFromPages(iter->second);
+  watchpoints_.erase(iter);
+  return absl::OkStatus();
+}
+
+void WatchpointMemory::ClearAllWatchpoints() {
+  watchpoints_.clear();
+  page_watchpoints_.clear();
+  std::fill(watched_pages_.begin(), watched_pages_.end(), 0);
+}
+
+template <typename F>
+void WatchpointMemory::ForEachOverlap(uint64_t address, uint64_t size,
+                                      F fn) const {
+  uint64_t last = address + size - 1;
+  for (uint64_t page = address >> kPageShift; page <= last >> kPageShift;
+       page++) {
+    auto iter = page_watchpoints_.find(page);
+    if (iter == page_watchpoints_.end()) continue;
+    uint64_t page_start = page << kPageShift;
+    for (auto const &watchpoint : iter->second) {
+      // A watchpoint that starts on an earlier page of the access has already
+      // been found there.
+      if ((page_start > address) && (watchpoint.start < page_start)) continue;
+      if ((watchpoint.start <= last) && (watchpoint.end > address)) {
+        fn(watchpoint);
+      }
+    }
+  }
+}
+
+bool WatchpointMemory::HitsLoad(uint64_t address, uint64_t size) const {
+  bool hit = false;
+  ForEachOverlap(address, size,
+                 [&hit](const Watchpoint &watchpoint) {
+                   hit |= (watchpoint.type == WatchType::kRead) ||
+                          (watchpoint.type == WatchType::kAccess);
+                 });
+  return hit;
+}
+
+bool WatchpointMemory::HitsStore(uint64_t address, DataBuffer *db) {
+  uint64_t size = db->size<uint8_t>();
+  bool hit = false;
+  DataBuffer *old_db = nullptr;
+  ForEachOverlap(address, size, [&](const Watchpoint &watchpoint) {
+    if (hit || (watchpoint.type == WatchType::kRead)) return;
+    if (watchpoint.type != WatchType::kChange) {
+      hit = true;
+      return;
+    }
+    // Compare the old and new values of the watched bytes.
+    if (old_db == nullptr) {
+      old_db = db_factory_.Allocate<uint8_t>(size);
+      memory_->Load(address, old_db, nullptr, nullptr);
+    }
+    uint64_t first = std::max(watchpoint.start, address) - address;
+    uint64_t last = std::min(watchpoint.end, address + size) - address;
+    auto *old_bytes = static_cast<const uint8_t *>(old_db->raw_ptr());
+    auto *new_bytes = static_cast<const uint8_t *>(db->raw_ptr());
+    hit = std::memcmp(old_bytes + first, new_bytes + first, last - first) != 0;
+  });
+  if (old_db != nullptr) old_db->DecRef();
+  return hit;
+}
+
+void WatchpointMemory::AddToPages(const Watchpoint &watchpoint) {
+  uint64_t last = (watchpoint.end - 1) >> kPageShift;
+  for (uint64_t page = watchpoint.start >> kPageShift; page <= last; page++) {
+    auto &watchpoints = page_watchpoints_[page];
+    watchpoints.push_back(watchpoint);
+    if (watchpoints.size() == 1) UpdatePageBits(page);
+  }
+}
+
+void WatchpointMemory::RemoveFromPages(const Watchpoint &watchpoint) {
+  uint64_t last = (watchpoint.end - 1) >> kPageShift;
+  for (uint64_t page = watchpoint.start >> kPageShift; page <= last; page++) {
+    auto iter = page_watchpoints_.find(page);
+    auto &watchpoints = iter->second;
+    watchpoints.erase(std::find_if(
+        watchpoints.begin(), watchpoints.end(),
+        [&watchpoint](const Watchpoint &other) {
+          return other.start == watchpoint.start;
+        }));
+    if (!watchpoints.empty()) continue;
+    page_watchpoints_.erase(iter);
+    UpdatePageBits(page);
+  }
+}
+
+void WatchpointMemory::UpdatePageBits(uint64_t page) {
+  // The bit of a page is set if it, or the page after it, is watched.
+  bool watched = page_watchpoints_.contains(page);
+  SetPageBit(page, watched || page_watchpoints_.contains(page + 1));
+  if (page > 0) {
+    SetPageBit(page - 1, watched || page_watchpoints_.contains(page - 1));
+  }
+}
+
+void WatchpointMemory::SetPageBit(uint64_t page, bool value) {
+  uint64_t index = page & (kNumPages - 1);
+  uint64_t mask = uint64_t{1} << (index & 63);
+  if (value) {
+    watched_pages_[index >> 6] |= mask;
+  } else {
+    watched_pages_[index >> 6] &= ~mask;
+  }
+}
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2023 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPACT_SIM_CODELABS_OTHER_WATCHPOINT_MEMORY_H_
+#define MPACT_SIM_CODELABS_OTHER_WATCHPOINT_MEMORY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/status/status.h"
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/generic/instruction.h"
+#include "mpact/sim/generic/ref_count.h"
+#include "mpact/sim/util/memory/memory_interface.h"
+
+namespace mpact {
+namespace sim {
+namespace codelab {
+
+using ::mpact::sim::generic::DataBuffer;
+using ::mpact::sim::generic::Instruction;
+using ::mpact::sim::generic::ReferenceCount;
+
+// Memory interface wrapper that implements data watchpoints on address ranges.
+// A bitmap with one bit per page records which pages may hold a watchpoint,
+// so that an access to an unwatched page costs a single bit test. Only
+// accesses to watched pages look up the watchpoints, which are indexed by the
+// pages they overlap. When an access hits a watchpoint, the access completes
+// and the hit callback is called. The wrapper doesn't own the memory.
+class WatchpointMemory : public util::MemoryInterface {
+ public:
+  // The watchpoint types, which follow those of gdb: kRead triggers on loads,
+  // kWrite on stores, kAccess on both, and kChange on stores that change the
+  // value of the watched memory.
+  enum class WatchType { kRead, kWrite, kAccess, kChange };
+  // Called with the address of the access that hit a watchpoint.
+  using HitCallback = absl::AnyInvocable<void(uint64_t address)>;
+
+  static constexpr int kPageShift = 12;
+  static constexpr uint64_t kNumPages = (uint64_t{1} << 32) >> kPageShift;
+
+  WatchpointMemory(util::MemoryInterface *memory, HitCallback on_hit);
+
+  void Load(uint64_t address, DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Load(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+            DataBuffer *db, Instruction *inst,
+            ReferenceCount *context) override;
+  void Store(uint64_t address, DataBuffer *db) override;
+  void Store(DataBuffer *address_db, DataBuffer *mask_db, int el_size,
+             DataBuffer *db) override;
+
+  // Watches [address, address + length). Watchpoints may overlap, but only one
+  // may start at any given address.
+  absl::Status SetWatchpoint(uint64_t address, uint64_t length,
+                             WatchType type);
+  // Clears the watchpoint that starts at the address.
+  absl::Status ClearWatchpoint(uint64_t address);
+  void ClearAllWatchpoints();
+  bool empty() const { return watchpoints_.empty(); }
+  // The bitmap of pages that may hold a watchpoint, one bit per page.
+  const std::vector<uint64_t> &watched_pages() const { return watched_pages_; }
+
+  util::MemoryInterface *memory() const { return memory_; }
+  void set_memory(util::MemoryInterface *memory) { memory_ = memory; }
+
+ private:
+  struct Watchpoint {
+    uint64_t start;
+    uint64_t end;
+    WatchType type;
+  };
+
+  // Returns true if the page of the address may hold a watchpoint. The page
+  // before each watched page is marked as well, so that an access that
+  // crosses into a watched page is caught by testing its start address.
+  bool IsWatched(uint64_t address) const {
+    uint64_t page = (address >> kPageShift) & (kNumPages - 1);
+    return (watched_pages_[page >> 6] >> (page & 63)) & 1;
+  }
+  // Calls fn(watchpoint) once for each watchpoint that overlaps
+  // [address, address + size).
+  template <typename F>
+  void ForEachOverlap(uint64_t address, uint64_t size, F fn) const;
+  // Returns true if a load of [address, address + size) hits a watchpoint.
+  bool HitsLoad(uint64_t address, uint64_t size) const;
+  // Returns true if storing db to address hits a watchpoint. Must be called
+  // before the store, so that value changes can be detected.
+  bool HitsStore(uint64_t address, DataBuffer *db);
+  // Add the watchpoint to, or remove it from, the index of each page it
+  // overlaps, updating the page bitmap as pages become (un)watched.
+  void AddToPages(const Watchpoint &watchpoint);
+  void RemoveFromPages(const Watchpoint &watchpoint);
+  // Recomputes the bitmap bits that depend on whether the page is watched.
+  void UpdatePageBits(uint64_t page);
+  void SetPageBit(uint64_t page, bool value);
+
+  util::MemoryInterface *memory_;
+  HitCallback on_hit_;
+  generic::DataBufferFactory db_factory_;
+  // Watchpoints indexed by start address.
+  absl::flat_hash_map<uint64_t, Watchpoint> watchpoints_;
+  // The watchpoints that overlap each watched page, indexed by page number.
+  absl::flat_hash_map<uint64_t, std::vector<Watchpoint>> page_watchpoints_;
+  // One bit per page.
+  std::vector<uint64_t> watched_pages_;
+};
+
+}  // namespace codelab
+}  // namespace sim
+}  // namespace mpact
+
+#endif  // MPACT_SIM_CODELABS_OTHER_WATCHPOINT_MEMORY_H_
@@ -0,0 +1,146 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "other/watchpoint_memory.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include "mpact/sim/generic/data_buffer.h"
+#include "mpact/sim/util/memory/flat_demand_memory.h"
+
+namespace {
+
+using ::mpact::sim::codelab::WatchpointMemory;
+using ::mpact::sim::generic::DataBufferFactory;
+using ::mpact::sim::util::FlatDemandMemory;
+using WatchType = WatchpointMemory::WatchType;
+
+class WatchpointMemoryTest : public testing::Test {
+ protected:
+  WatchpointMemoryTest()
+      : memory_(0), watchpoints_(&memory_, [this](uint64_t address) {
+          hits_.push_back(address);
+        }) {}
+
+  void StoreWord(uint64_t address, uint32_t value) {
+    auto *db = db_factory_.Allocate<uint32_t>(1);
+    db->Set<uint32_t>(0, value);
+    watchpoints_.Store(address, db);
+    db->DecRef();
+  }
+
+  void LoadWord(uint64_t address) {
+    auto *db = db_factory_.Allocate<uint32_t>(1);
+    watchpoints_.Load(address, db, nullptr, nullptr);
+    db->DecRef();
+  }
+
+  bool IsPageMarked(uint64_t address) const {
+    uint64_t page = address >> WatchpointMemory::kPageShift;
+    return (watchpoints_.watched_pages()[page >> 6] >> (page & 63)) & 1;
+  }
+
+  DataBufferFactory db_factory_;
+  FlatDemandMemory memory_;
+  WatchpointMemory watchpoints_;
+  std::vector<uint64_t> hits_;
+};
+
+// A change watchpoint only covers part of the stored word, so only changes to
+// the watched bytes are reported.
+TEST_F(WatchpointMemoryTest, ChangePartialOverlap) {
+  StoreWord(0x1000, 0x4433'2211);
+  ASSERT_TRUE(watchpoints_.SetWatchpoint(0x1002, 2, WatchType::kChange).ok());
+  // Only the unwatched low bytes change.
+  StoreWord(0x1000, 0x4433'aabb);
+  EXPECT_TRUE(hits_.empty());
+  // Storing the same value isn't a change.
+  StoreWord(0x1000, 0x4433'aabb);
+  EXPECT_TRUE(hits_.empty());
+  // The watched high byte changes.
+  StoreWord(0x1000, 0x5533'aabb);
+  ASSERT_EQ(hits_.size(), 1u);
+  EXPECT_EQ(hits_[0], 0x1000u);
+  // A store that starts inside the watched range and extends past it.
+  StoreWord(0x1003, 0xffff'ff66);
+  ASSERT_EQ(hits_.size(), 2u);
+  EXPECT_EQ(hits_[1], 0x1003u);
+  // A store that starts past the watched range.
+  StoreWord(0x1004, 0x1234'5678);
+  EXPECT_EQ(hits_.size(), 2u);
+}
+
+// Accesses that start on the page before a watched page, and cross into the
+// watched bytes, hit the watchpoint.
+TEST_F(WatchpointMemoryTest, AccessCrossingIntoWatchedPage) {
+  ASSERT_TRUE(watchpoints_.SetWatchpoint(0x3000, 4, WatchType::kAccess).ok());
+  EXPECT_TRUE(IsPageMarked(0x2000));
+  EXPECT_TRUE(IsPageMarked(0x3000));
+  EXPECT_FALSE(IsPageMarked(0x1000));
+  EXPECT_FALSE(IsPageMarked(0x4000));
+  // Ends just before the watchpoint.
+  StoreWord(0x2ffc, 1);
+  LoadWord(0x2ffc);
+  EXPECT_TRUE(hits_.empty());
+  StoreWord(0x2ffe, 1);
+  LoadWord(0x2ffd);
+  ASSERT_EQ(hits_.size(), 2u);
+  EXPECT_EQ(hits_[0], 0x2ffeu);
+  EXPECT_EQ(hits_[1], 0x2ffdu);
+}
+
+// A watchpoint that spans two pages is found from accesses to either page,
+// including one that covers both.
+TEST_F(WatchpointMemoryTest, WatchpointAcrossPages) {
+  ASSERT_TRUE(watchpoints_.SetWatchpoint(0x1ffe, 4, WatchType::kChange).ok());
+  StoreWord(0x1ffe, 0x0101'0101);
+  EXPECT_EQ(hits_.size(), 1u);
+  StoreWord(0x2000, 0x0202'0202);
+  EXPECT_EQ(hits_.size(), 2u);
+  StoreWord(0x2002, 0x0303'0303);
+  EXPECT_EQ(hits_.size(), 2u);
+}
+
+// The page bitmap is kept up to date as watchpoints are set and cleared.
+TEST_F(WatchpointMemoryTest, PageBitmapTracksWatchpoints) {
+  ASSERT_TRUE(watchpoints_.SetWatchpoint(0x5000, 8, WatchType::kWrite).ok());
+  ASSERT_TRUE(watchpoints_.SetWatchpoint(0x5800, 8, WatchType::kRead).ok());
+  ASSERT_TRUE(watchpoints_.SetWatchpoint(0x6ff0, 0x20, WatchType::kRead).ok());
+  EXPECT_FALSE(watchpoints_.SetWatchpoint(0x5000, 4, WatchType::kRead).ok());
+  for (uint64_t page = 0x4000; page <= 0x7000; page += 0x1000) {
+    EXPECT_TRUE(IsPageMarked(page)) << page;
+  }
+  ASSERT_TRUE(watchpoints_.ClearWatchpoint(0x5000).ok());
+  // Page 0x5000 still holds a watchpoint.
+  EXPECT_TRUE(IsPageMarked(0x4000));
+  EXPECT_TRUE(IsPageMarked(0x5000));
+  StoreWord(0x5000, 1);
+  EXPECT_TRUE(hits_.empty());
+  ASSERT_TRUE(watchpoints_.ClearWatchpoint(0x5800).ok());
+  EXPECT_FALSE(IsPageMarked(0x4000));
+  // Page 0x5000 is the page before the remaining watchpoint.
+  EXPECT_TRUE(IsPageMarked(0x5000));
+  EXPECT_TRUE(IsPageMarked(0x6000));
+  EXPECT_TRUE(IsPageMarked(0x7000));
+  EXPECT_FALSE(watchpoints_.ClearWatchpoint(0x5800).ok());
+  ASSERT_TRUE(watchpoints_.ClearWatchpoint(0x6ff0).ok());
+  EXPECT_TRUE(watchpoints_.empty());
+  for (uint64_t page = 0x4000; page <= 0x7000; page += 0x1000) {
+    EXPECT_FALSE(IsPageMarked(page)) << page;
+  }
+}
+
+}  // namespace
@@ -14,6 +14,8 @@
 
 #include "riscv_full_decoder/solution/riscv32_decoder.h"
 
+#include "other/rv32i_inplace_instructions.h"
+
 namespace mpact {
 namespace sim {
 namespace codelab {
@@ -49,6 +51,9 @@ generic::Instruction *RiscV32Decoder::DecodeInstruction(uint64_t address) {
   // Call the isa decoder to obtain a new instruction object for the instruction
   // word that was parsed above.
   auto *instruction = riscv_isa_->Decode(address, riscv_encoding_);
+  // The encoding creates rd destinations that can be written in place, so use
+  // the semantic functions that do so.
+  UseInPlaceSemanticFunction(instruction);
   return instruction;
 }
 
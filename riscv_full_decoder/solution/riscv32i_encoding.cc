@@ -14,9 +14,6 @@
 
 #include "riscv_full_decoder/solution/riscv32i_encoding.h"
 
-#include <string>
-
-#include "mpact/sim/generic/devnull_operand.h"
 #include "mpact/sim/generic/immediate_operand.h"
 #include "mpact/sim/generic/literal_operand.h"
 #include "mpact/sim/generic/operand_interface.h"
@@ -31,44 +28,12 @@ namespace codelab {
 using riscv::RiscVState;
 using riscv::RV32Register;
 
-using generic::DevNullOperand;
 using generic::ImmediateOperand;
 using generic::IntLiteralOperand;
 
-// Generic helper functions to create register operands.
-template <typename RegType>
-inline DestinationOperandInterface *GetRegisterDestinationOp(
-    RiscVState *state, const std::string &name, int latency) {
-  auto *reg = state->GetRegister<RegType>(name).first;
-  return reg->CreateDestinationOperand(latency);
-}
-
-template <typename RegType>
-inline DestinationOperandInterface *GetRegisterDestinationOp(
-    RiscVState *state, const std::string &name, int latency,
-    const std::string &op_name) {
-  auto *reg = state->GetRegister<RegType>(name).first;
-  return reg->CreateDestinationOperand(latency, op_name);
-}
-
-template <typename RegType>
-inline SourceOperandInterface *GetRegisterSourceOp(RiscVState *state,
-                                                   const std::string &name) {
-  auto [reg_ptr, unused] = state->GetRegister<RegType>(name);
-  auto *op = reg_ptr->CreateSourceOperand();
-  return op;
-}
-
-template <typename RegType>
-inline SourceOperandInterface *GetRegisterSourceOp(RiscVState *state,
-                                                   const std::string &name,
-                                                   const std::string &op_name) {
-  auto [reg_ptr, unused] = state->GetRegister<RegType>(name);
-  auto *op = reg_ptr->CreateSourceOperand(op_name);
-  return op;
-}
-
 RiscV32IEncoding::RiscV32IEncoding(RiscVState *state) : state_(state) {
+  csr_ = state_->GetRegister<RV32Register>(RiscVState::kCsrName).first;
+  pc_ = state_->GetRegister<RV32Register>(RiscVState::kPcName).first;
   InitializeSourceOperandGetters();
   InitializeDestinationOperandGetters();
 }
@@ -96,20 +61,14 @@ void RiscV32IEncoding::InitializeDestinationOperandGetters() {
     return nullptr;
   };
   dest_op_getters_[static_cast<int>(DestOpEnum::kCsr)] = [this](int latency) {
-    return GetRegisterDestinationOp<RV32Register>(state_, "CSR", latency);
+    return csr_->CreateDestinationOperand(latency);
   };
   dest_op_getters_[static_cast<int>(DestOpEnum::kNextPc)] =
-      [this](int latency) {
-        return GetRegisterDestinationOp<RV32Register>(
-            state_, RiscVState::kPcName, latency);
-      };
-  dest_op_getters_[static_cast<int>(DestOpEnum::kRd)] =
-      [this](int latency) -> DestinationOperandInterface * {
+      [this](int latency) { return pc_->CreateDestinationOperand(latency); };
+  dest_op_getters_[static_cast<int>(DestOpEnum::kRd)] = [this](int latency) {
+    // Writes to x0 are discarded by the operand.
     int num = inst32_format::ExtractRd(inst_word_);
-    if (num == 0) return new DevNullOperand<uint32_t>(state_, {1});
-    return GetRegisterDestinationOp<RV32Register>(
-        state_, absl::StrCat(RiscVState::kXregPrefix, num), latency,
-        xreg_alias_[num]);
+    return state_->CreateXregDestinationOperand(num, latency, xreg_alias_[num]);
   };
 }
 
@@ -122,21 +81,19 @@ void RiscV32IEncoding::InitializeSourceOperandGetters() {
 
   // Register operands.
   source_op_getters_[static_cast<int>(SourceOpEnum::kCsr)] = [this]() {
-    return GetRegisterSourceOp<RV32Register>(state_, "CSR");
+    return csr_->CreateSourceOperand();
   };
   source_op_getters_[static_cast<int>(SourceOpEnum::kRs1)] =
       [this]() -> SourceOperandInterface * {
     int num = inst32_format::ExtractRs1(inst_word_);
     if (num == 0) return new IntLiteralOperand<0>({1}, xreg_alias_[0]);
-    return GetRegisterSourceOp<RV32Register>(
-        state_, absl::StrCat(RiscVState::kXregPrefix, num), xreg_alias_[num]);
+    return state_->CreateXregSourceOperand(num, xreg_alias_[num]);
   };
   source_op_getters_[static_cast<int>(SourceOpEnum::kRs2)] =
       [this]() -> SourceOperandInterface * {
     int num = inst32_format::ExtractRs2(inst_word_);
     if (num == 0) return new IntLiteralOperand<0>({1}, xreg_alias_[0]);
-    return GetRegisterSourceOp<RV32Register>(
-        state_, absl::StrCat(RiscVState::kXregPrefix, num), xreg_alias_[num]);
+    return state_->CreateXregSourceOperand(num, xreg_alias_[num]);
   };
 
   // Immediates.
@@ -22,6 +22,7 @@
 
 #include "absl/functional/any_invocable.h"
 #include "mpact/sim/generic/operand_interface.h"
+#include "other/riscv_register.h"
 #include "other/riscv_simple_state.h"
 #include "riscv_isa_decoder/solution/riscv32i_decoder.h"
 #include "riscv_isa_decoder/solution/riscv32i_enums.h"
@@ -97,6 +98,11 @@ class RiscV32IEncoding : public RiscV32IEncodingBase {
   uint32_t inst_word_;
   OpcodeEnum opcode_;
 
+  // Resolved once when the encoding is created, so that decoding doesn't look
+  // up registers by name. The integer registers are resolved by the state.
+  riscv::RV32Register *csr_;
+  riscv::RV32Register *pc_;
+
   absl::AnyInvocable<SourceOperandInterface *()>
       source_op_getters_[static_cast<int>(SourceOpEnum::kPastMaxValue)];
   absl::AnyInvocable<DestinationOperandInterface *(int)>